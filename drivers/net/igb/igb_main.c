@@ -2722,6 +2722,9 @@ static void igb_clean_tx_ring(struct igb_ring *tx_ring)
 
 	tx_ring->next_to_use = 0;
 	tx_ring->next_to_clean = 0;
+
+	netdev_tx_reset_queue(netdev_get_tx_queue(tx_ring->netdev,
+						  tx_ring->queue_index));
 }
 
 /**
@@ -3808,6 +3811,9 @@ netdev_tx_t igb_xmit_frame_ring_adv(struct sk_buff *skb,
 		return NETDEV_TX_OK;
 	}
 
+	netdev_tx_sent_queue(netdev_get_tx_queue(tx_ring->netdev,
+						 tx_ring->queue_index),
+			     skb->len);
 	igb_tx_queue_adv(tx_ring, tx_flags, count, skb->len, hdr_len);
 
 	/* Make sure there is space in the ring for the next send. */
@@ -4996,6 +5002,7 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 	struct sk_buff *skb;
 	union e1000_adv_tx_desc *tx_desc, *eop_desc;
 	unsigned int total_bytes = 0, total_packets = 0;
+	unsigned int bytes_compl = 0, pkts_compl = 0;
 	unsigned int i, eop, count = 0;
 	bool cleaned = false;
 
@@ -5020,6 +5027,8 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 					    skb->len;
 				total_packets += segs;
 				total_bytes += bytecount;
+				bytes_compl += skb->len;
+				pkts_compl++;
 
 				igb_tx_hwtstamp(q_vector, skb);
 			}
@@ -5037,6 +5046,10 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 
 	tx_ring->next_to_clean = i;
 
+	netdev_tx_completed_queue(netdev_get_tx_queue(netdev,
+						      tx_ring->queue_index),
+				  pkts_compl, bytes_compl);
+
 	if (unlikely(count &&
 		     netif_carrier_ok(netdev) &&
 		     igb_desc_unused(tx_ring) >= IGB_TX_QUEUE_WAKE)) {
@@ -84,6 +84,15 @@ static netdev_tx_t loopback_xmit(struct sk_buff *skb,
 	pcpu_lstats = (void __percpu __force *)dev->ml_priv;
 	lb_stats = this_cpu_ptr(pcpu_lstats);
 
+	/* A local reader may sit on the data indefinitely, do not keep
+	 * the sender's MSG_ZEROCOPY pages pinned that long.
+	 */
+	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC))) {
+		kfree_skb(skb);
+		lb_stats->drops++;
+		return NETDEV_TX_OK;
+	}
+
 	len = skb->len;
 	if (likely(netif_rx(skb) == NET_RX_SUCCESS)) {
 		lb_stats->bytes += len;
@@ -33,6 +33,7 @@
 #include <linux/bitops.h>
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
+#include <net/busy_poll.h>
 #include <asm/uaccess.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -239,6 +240,12 @@ struct eventpoll {
 	/* The user that created the eventpoll descriptor */
 	/* 创建 eventpoll 描述符的用户 */
 	struct user_struct *user;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	/* used to track busy poll napi_id */
+	/* 记录忙轮询所用的 NAPI 实例 id */
+	unsigned int napi_id;
+#endif
 };
 
 /* Wait structure used by the poll hooks */
@@ -356,6 +363,88 @@ static inline int ep_is_linked(struct list_head *p)
 	return !list_empty(p);  // 如果列表不为空，返回 true，表示项已链接
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* 判断是否有就绪事件（包括正在传输期间到达的事件） */
+static inline int ep_events_available(struct eventpoll *ep)
+{
+	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+}
+
+static bool ep_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct eventpoll *ep = p;
+
+	return ep_events_available(ep) || busy_loop_timeout(start_time);
+}
+
+/*
+ * Busy poll if globally on and supporting sockets found && no events,
+ * busy loop will return if need_resched or ep_events_available.
+ *
+ * we must do our busy polling with irqs enabled
+ */
+/* 全局开启忙轮询且记录了 NAPI id 时，在睡眠前直接轮询该 NAPI 实例 */
+static void ep_busy_loop(struct eventpoll *ep, int nonblock)
+{
+	unsigned int napi_id = ACCESS_ONCE(ep->napi_id);
+
+	if (napi_id && net_busy_loop_on())
+		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep);
+}
+
+static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
+{
+	if (ep->napi_id)
+		ep->napi_id = 0;
+}
+
+/*
+ * Set epoll busy poll NAPI ID from sk.
+ */
+/* 从套接字记录的 NAPI id 更新 eventpoll 的忙轮询目标 */
+static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
+{
+	struct eventpoll *ep;
+	unsigned int napi_id;
+	struct socket *sock;
+	struct sock *sk;
+	int err;
+
+	if (!net_busy_loop_on())
+		return;
+
+	sock = sock_from_file(epi->ffd.file, &err);
+	if (!sock)
+		return;
+
+	sk = sock->sk;
+	if (!sk)
+		return;
+
+	napi_id = ACCESS_ONCE(sk->sk_napi_id);
+	ep = epi->ep;
+
+	/* Non-NAPI IDs can be rejected or if the napi_id is unchanged */
+	if (!napi_id || napi_id == ep->napi_id)
+		return;
+
+	/* record NAPI ID for use in next busy poll */
+	ep->napi_id = napi_id;
+}
+#else
+static inline void ep_busy_loop(struct eventpoll *ep, int nonblock)
+{
+}
+
+static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
+{
+}
+
+static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
+{
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /* Get the "struct epitem" from a wait queue pointer */
 /* 从等待队列指针获取 "struct epitem" */
 static inline struct epitem *ep_item_from_wait(wait_queue_t *p)
@@ -1212,6 +1301,9 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	if (epi->nwait < 0)	// 检查在 poll 等待队列安装过程中是否发生错误。
 		goto error_unregister;
 
+	/* Start busy polling the socket's NAPI instance, if it has one */
+	ep_set_busy_poll_napi_id(epi);	// 记录套接字的 NAPI id 以便忙轮询
+
 	/* Add the current item to the list of active epoll hook for this file */
 	/* 将新的 epitem 链接到文件的 epoll 钩子列表中。 */
 	spin_lock(&tfile->f_lock);
@@ -1384,6 +1476,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 		 * 因此任何来自用户空间的操作都无法更改该项。
 		 */
 		if (revents) {
+			ep_set_busy_poll_napi_id(epi);	// 就绪的套接字决定下一次忙轮询的 NAPI 实例
 			if (__put_user(revents, &uevent->events) ||
 			    __put_user(epi->event.data, &uevent->data)) {
 				list_add(&epi->rdllink, head);	// 如果复制到用户空间失败，将事件项重新添加到列表
@@ -1454,10 +1547,22 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		MAX_SCHEDULE_TIMEOUT : (timeout * HZ + 999) / 1000;	// 将毫秒转换为系统节拍
 
 retry:
+	/* Spin on the NAPI instance feeding us before going to sleep */
+	if (list_empty(&ep->rdllist))
+		ep_busy_loop(ep, !jtimeout);	// 睡眠前先忙轮询网卡
+
 	spin_lock_irqsave(&ep->lock, flags);	// 加锁，保护临界区
 
 	res = 0;	// 初始化结果为 0
 	if (list_empty(&ep->rdllist)) {
+		/*
+		 * Busy poll timed out.  Drop NAPI ID for now, we can add
+		 * it back in when we have moved a socket with a valid NAPI
+		 * ID onto the ready list.
+		 */
+		/* 忙轮询超时，先丢弃 NAPI id，待有效套接字就绪时再记录 */
+		ep_reset_busy_poll_napi_id(ep);
+
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
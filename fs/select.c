@@ -27,6 +27,8 @@
 #include <linux/rcupdate.h>
 #include <linux/hrtimer.h>
 
+#include <net/busy_poll.h>
+
 #include <asm/uaccess.h>
 
 
@@ -508,15 +510,17 @@ get_max:
  * @in: 表示要检测输入相关事件的位掩码
  * @out: 表示要检测输出相关事件的位掩码
  * @bit: 当前处理的特定事件位
+ * @ll_flag: 忙轮询请求标志（POLL_BUSY_LOOP 或 0）
  * 
  * 此函数根据输入和输出位掩码以及当前事件位更新poll_table结构的key字段。
  * 如果指定事件位在输入或输出掩码中设置，则相应的事件集合会被加入到key中。
  */
 static inline void wait_key_set(poll_table *wait, unsigned long in,
-				unsigned long out, unsigned long bit)
+				unsigned long out, unsigned long bit,
+				unsigned int ll_flag)
 {
 	if (wait) { // 如果提供了有效的poll_table结构指针
-		wait->key = POLLEX_SET; // 首先设置异常事件集
+		wait->key = POLLEX_SET | ll_flag; // 首先设置异常事件集及忙轮询标志
 		if (in & bit) // 如果输入掩码中包含当前事件位
 			wait->key |= POLLIN_SET; // 则添加输入相关的事件集到key
 		if (out & bit) // 如果输出掩码中包含当前事件位
@@ -530,8 +534,11 @@ int do_select(int n, fd_set_bits *fds, struct timespec *end_time)
 	ktime_t expire, *to = NULL;  // 定义超时时间结构
 	struct poll_wqueues table;   // 定义等待队列结构
 	poll_table *wait;            // 定义poll表指针
+	poll_table busy_pt;          // 忙轮询时使用的poll表，不注册等待队列
 	int retval, i, timed_out = 0; // 定义返回值、循环变量和超时标志
 	unsigned long slack = 0;      // 定义时间精度变量
+	unsigned int busy_flag = net_busy_loop_on() ? POLL_BUSY_LOOP : 0;
+	unsigned long busy_start = 0; // 忙轮询开始时间
 
 	rcu_read_lock(); // 读取锁定，防止数据竞争
 	retval = max_select_fd(n, fds); // 获取最大文件描述符数
@@ -542,9 +549,11 @@ int do_select(int n, fd_set_bits *fds, struct timespec *end_time)
 	n = retval;	// 设置有效的文件描述符数
 
 	poll_initwait(&table);	// 初始化poll等待队列
+	init_poll_funcptr(&busy_pt, NULL);
 	wait = &table.pt;	// 获取等待队列的poll表指针
 	if (end_time && !end_time->tv_sec && !end_time->tv_nsec) {
-		wait = NULL;	// 如果超时时间为0，则不设置等待
+		/* still let sockets busy poll once, without queueing us */
+		wait = busy_flag ? &busy_pt : NULL;	// 如果超时时间为0，则不设置等待
 		timed_out = 1;	// 设置超时标志
 	}
 
@@ -554,6 +563,7 @@ int do_select(int n, fd_set_bits *fds, struct timespec *end_time)
 	retval = 0;	// 初始化返回值
 	for (;;) {	// 无限循环，直到遇到break语句
 		unsigned long *rinp, *routp, *rexp, *inp, *outp, *exp;
+		bool can_busy_loop = false;	// 本轮是否有可忙轮询的套接字
 		inp = fds->in; outp = fds->out; exp = fds->ex;  // 指向用户提供的输入、输出和异常文件描述符集合
 		rinp = fds->res_in; routp = fds->res_out; rexp = fds->res_ex;  // 指向结果集合，将在此存储有事件的文件描述符
 
@@ -581,7 +591,8 @@ int do_select(int n, fd_set_bits *fds, struct timespec *end_time)
 					f_op = file->f_op;  // 获取文件操作指针
 					mask = DEFAULT_POLLMASK;  // 设置默认的事件掩码
 					if (f_op && f_op->poll) {  // 如果定义了poll方法
-						wait_key_set(wait, in, out, bit);  // 设置poll表中的键值
+						wait_key_set(wait, in, out, bit,
+							     busy_flag);  // 设置poll表中的键值
 						mask = (*f_op->poll)(file, wait);  // 调用poll方法
 					}
 				fput_light(file, fput_needed);  // 释放文件结构
@@ -600,6 +611,17 @@ int do_select(int n, fd_set_bits *fds, struct timespec *end_time)
 						retval++;  // 增加返回的计数
 						wait = NULL;  // 清除等待指针
 					}
+					/* got something, stop busy polling */
+					if (retval) {
+						can_busy_loop = false;
+						busy_flag = 0;
+
+					/*
+					 * only remember a returned
+					 * POLL_BUSY_LOOP if we asked for it
+					 */
+					} else if (busy_flag & mask)
+						can_busy_loop = true;  // 该套接字支持忙轮询
 				}
 			}
 			if (res_in)
@@ -618,6 +640,18 @@ int do_select(int n, fd_set_bits *fds, struct timespec *end_time)
 			break;	// 并终止循环
 		}
 
+		/* only if found POLL_BUSY_LOOP sockets && not out of time */
+		// 存在可忙轮询的套接字且忙轮询时间未用完时，不睡眠而是再扫描一轮
+		if (can_busy_loop && !need_resched()) {
+			if (!busy_start)
+				busy_start = busy_loop_current_time();
+			if (!busy_loop_timeout(busy_start)) {
+				wait = &busy_pt;
+				continue;
+			}
+		}
+		busy_flag = 0;
+
 		/*
 		 * If this is the first loop and we have a timeout
 		 * given, then we convert to ktime_t and set the to
@@ -902,7 +936,9 @@ struct poll_list {
  * 匹配该掩码的结果将被记录在 pollfd->revents 中并返回。如果 pwait 非空，则 poll_table 将被
  * 用于等待，由文件描述符提供的 poll 处理程序。
  */
-static inline unsigned int do_pollfd(struct pollfd *pollfd, poll_table *pwait)
+static inline unsigned int do_pollfd(struct pollfd *pollfd, poll_table *pwait,
+				     bool *can_busy_poll,
+				     unsigned int busy_flag)
 {
 	unsigned int mask;  // 用于存储事件掩码
 	int fd;  // 文件描述符
@@ -918,9 +954,13 @@ static inline unsigned int do_pollfd(struct pollfd *pollfd, poll_table *pwait)
 		if (file != NULL) {  // 如果成功获取文件
 			mask = DEFAULT_POLLMASK;  // 重置掩码为默认的事件掩码
 			if (file->f_op && file->f_op->poll) {  // 检查文件操作是否存在且包含 poll 方法
-				if (pwait)  // 如果提供了等待队列
+				if (pwait) {  // 如果提供了等待队列
 					pwait->key = pollfd->events | POLLERR | POLLHUP;  // 设置等待队列的事件掩码
+					pwait->key |= busy_flag;  // 请求支持的套接字进行一次忙轮询
+				}
 				mask = file->f_op->poll(file, pwait);  // 调用 poll 方法获取事件掩码
+				if (mask & busy_flag)
+					*can_busy_poll = true;  // 该套接字支持忙轮询
 			}
 			/* Mask out unneeded events. */
 			/* 掩蔽不需要的事件 */
@@ -937,14 +977,20 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 		   struct poll_wqueues *wait, struct timespec *end_time)
 {
 	poll_table* pt = &wait->pt; // 指向等待队列的 poll_table 结构
+	poll_table busy_pt; // 忙轮询时使用的 poll_table，不注册等待队列
 	ktime_t expire, *to = NULL; // 用于处理超时
 	int timed_out = 0, count = 0; // timed_out 指示是否超时，count 记录检测到的事件数量
 	unsigned long slack = 0; // 用于调整超时精度
+	unsigned int busy_flag = net_busy_loop_on() ? POLL_BUSY_LOOP : 0;
+	unsigned long busy_start = 0; // 忙轮询开始时间
+
+	init_poll_funcptr(&busy_pt, NULL);
 
 	/* Optimise the no-wait case */
 	/* 优化无等待情况 */
 	if (end_time && !end_time->tv_sec && !end_time->tv_nsec) {
-		pt = NULL; // 如果指定的超时时间为零，不需要等待队列
+		/* still let sockets busy poll once, without queueing us */
+		pt = busy_flag ? &busy_pt : NULL; // 如果指定的超时时间为零，不需要等待队列
 		timed_out = 1; // 直接设置为超时
 	}
 
@@ -953,6 +999,7 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 
 	for (;;) {	// 循环处理所有 pollfd 结构
 		struct poll_list *walk;
+		bool can_busy_loop = false;	// 本轮是否有可忙轮询的套接字
 
 		for (walk = list; walk != NULL; walk = walk->next) {	// 遍历 poll_list 链表
 			struct pollfd * pfd, * pfd_end;
@@ -971,9 +1018,13 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 				 * 查找事件。如果找到事件，记录它，并且清除 poll_table，
 				 * 这样之后不再无谓地注册其他等待者。一旦返回，会立即注销所有等待者。
 				 */
-				if (do_pollfd(pfd, pt)) {
+				if (do_pollfd(pfd, pt, &can_busy_loop,
+					      busy_flag)) {
 					count++;	// 增加找到的事件数量
 					pt = NULL;	// 清除 poll_table，避免再次注册
+					/* found something, stop busy polling */
+					busy_flag = 0;
+					can_busy_loop = false;
 				}
 			}
 		}
@@ -991,6 +1042,18 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 		if (count || timed_out) // 如果检测到事件或超时，结束循环
 			break;
 
+		/* only if found POLL_BUSY_LOOP sockets && not out of time */
+		// 存在可忙轮询的套接字且忙轮询时间未用完时，不睡眠而是再扫描一轮
+		if (can_busy_loop && !need_resched()) {
+			if (!busy_start)
+				busy_start = busy_loop_current_time();
+			if (!busy_loop_timeout(busy_start)) {
+				pt = &busy_pt;
+				continue;
+			}
+		}
+		busy_flag = 0;
+
 		/*
 		 * If this is the first loop and we have a timeout
 		 * given, then we convert to ktime_t and set the to
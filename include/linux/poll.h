@@ -28,6 +28,13 @@ extern struct ctl_table epoll_table[]; /* for sysctl */
 
 #define DEFAULT_POLLMASK (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM)  // 定义默认的轮询掩码
 
+/*
+ * Set in poll_table->key by select/poll to ask sockets for a busy poll,
+ * and echoed back in the mask by sockets able to do so.  Never reported
+ * to user space.
+ */
+#define POLL_BUSY_LOOP	0x8000  // 请求/声明支持忙轮询，不返回给用户态
+
 struct poll_table_struct;  // 前置声明轮询表结构
 
 /* 
@@ -48,8 +55,8 @@ typedef struct poll_table_struct {
 // 此内联函数用于将文件描述符注册到指定的等待队列中。
 static inline void poll_wait(struct file * filp, wait_queue_head_t * wait_address, poll_table *p)
 {
-	// 如果提供了有效的轮询表和等待地址，则调用轮询表中定义的回调函数来处理注册操作
-	if (p && wait_address)
+	// 如果提供了有效的轮询表、回调函数和等待地址，则调用轮询表中定义的回调函数来处理注册操作
+	if (p && p->qproc && wait_address)
 		p->qproc(filp, wait_address, p);
 }
 
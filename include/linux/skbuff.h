@@ -229,6 +229,8 @@ struct skb_shared_hwtstamps {
  * @software:		generate software time stamp
  * @in_progress:	device driver is going to provide
  *			hardware time stamp
+ * @dev_zerocopy:	frags reference user pages, destructor_arg
+ *			points to the &struct ubuf_info to complete
  * @flags:		all shared_tx flags
  *
  * These flags are attached to packets as part of the
@@ -239,6 +241,7 @@ struct skb_shared_hwtstamps {
  * @hardware:		生成硬件时间戳
  * @software:		生成软件时间戳
  * @in_progress:	设备驱动程序将要提供硬件时间戳
+ * @dev_zerocopy:	分片引用用户页，destructor_arg 指向待完成的 &struct ubuf_info
  * @flags:		所有 shared_tx 标志
  *
  * 这些标志作为 &skb_shared_info 的一部分附加到数据包上。使用 skb_tx() 获取指针。
@@ -247,7 +250,8 @@ union skb_shared_tx {
 	struct {
 		__u8	hardware:1,       // 1位，标志是否生成硬件时间戳
 			software:1,       // 1位，标志是否生成软件时间戳
-			in_progress:1;    // 1位，标志硬件时间戳的生成是否正在进行
+			in_progress:1,    // 1位，标志硬件时间戳的生成是否正在进行
+			dev_zerocopy:1;   // 1位，标志分片引用的是用户页（MSG_ZEROCOPY）
 	};
 	__u8 flags;                 // 同样的标志，作为一个单独的字节，便于操作和访问
 };
@@ -280,6 +284,27 @@ struct skb_shared_info {
 	void *		destructor_arg;       // 析构函数参数，用于在 skb 被销毁时传递额外的上下文信息
 };
 
+/*
+ * MSG_ZEROCOPY completion state.  The structure lives in the cb[] of an
+ * skb allocated up front, which is later queued on sk_error_queue as the
+ * notification, so completing a send can never fail for lack of memory.
+ * Every skb_shared_info that references the user pages holds a reference;
+ * the callback runs when the last one is gone.
+ */
+/*
+ * MSG_ZEROCOPY 完成状态。该结构位于预先分配的 skb 的 cb[] 中，
+ * 之后这个 skb 作为通知挂到 sk_error_queue 上，因此完成通知不会因为缺少内存而失败。
+ * 每个引用用户页的 skb_shared_info 都持有一个引用，最后一个引用释放时调用回调。
+ */
+struct ubuf_info {
+	void (*callback)(struct ubuf_info *, bool zerocopy_success); // 完成回调
+	u32		id;		// 本区间的第一个发送序号
+	u16		len;		// 本区间包含的发送调用数
+	u16		zerocopy:1;	// 为 0 表示数据最终被复制
+	u32		bytelen;	// 本区间累计的字节数
+	atomic_t	refcnt;		// 引用计数
+};
+
 /* We divide dataref into two halves.  The higher 16 bits hold references
  * to the payload part of skb->data.  The lower 16 bits hold references to
  * the entire skb->data.  A clone of a headerless skb holds the length of
@@ -323,6 +348,16 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,  // GSO 标志：IPv6 TCP 分段卸载标志
 
 	SKB_GSO_FCOE = 1 << 5,   // GSO 标志：FCoE（以太网光纤通道）分段卸载标志
+
+	/* This indicates a train of equal sized UDP datagrams, each of which
+	 * gets its own UDP header when segmented. */
+	/* 这表示一串等长的 UDP 数据报，分段后每个数据报都有自己的 UDP 头。 */
+	SKB_GSO_UDP_L4 = 1 << 6, // GSO 标志：UDP 数据报分段卸载标志
+
+	/* This indicates the packet sits behind IPv4 tunnel headers (GRE or
+	 * IPIP) that are copied into every segment. */
+	/* 这表示数据包位于 IPv4 隧道头（GRE 或 IPIP）之后，每个分段都复制这些隧道头。 */
+	SKB_GSO_TUNNEL = 1 << 7, // GSO 标志：隧道封装的数据包
 };
 
 /* 如果系统位数超过 32 位，则定义 NET_SKBUFF_DATA_USES_OFFSET */
@@ -384,10 +419,14 @@ typedef unsigned char *sk_buff_data_t;  // 否则，定义 sk_buff_data_t 为无
  *	@nfct_reasm: netfilter conntrack re-assembly pointer
  *	@nf_bridge: Saved data about a bridged frame - see br_netfilter.c
  *	@skb_iif: ifindex of device we arrived on
+ *	@rxhash: the packet hash computed on receive
  *	@queue_mapping: Queue mapping for multiqueue devices
  *	@tc_index: Traffic control index
  *	@tc_verd: traffic control verdict
  *	@ndisc_nodetype: router type (from link layer)
+ *	@ooo_okay: allow the mapping of a socket to a queue to be changed
+ *	@head_frag: head was carved out of a page fragment, not kmalloc()ed
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
  *	@secmark: security marking
@@ -438,10 +477,14 @@ typedef unsigned char *sk_buff_data_t;  // 否则，定义 sk_buff_data_t 为无
  *	@nfct_reasm: netfilter conntrack 重组指针
  *	@nf_bridge: 保存有关桥接帧的数据 - 见 br_netfilter.c
  *	@skb_iif: 我们到达的设备的接口索引
+ *	@rxhash: 接收时计算的数据包哈希值
  *	@queue_mapping: 多队列设备的队列映射
  *	@tc_index: 流量控制索引
  *	@tc_verd: 流量控制裁决
  *	@ndisc_nodetype: 路由器类型（来自链路层）
+ *	@ooo_okay: 允许改变套接字到发送队列的映射
+ *	@head_frag: 数据区取自页面片段，而不是 kmalloc() 分配的
+ *	@napi_id: 接收此 skb 的 NAPI 实例的 id
  *	@dma_cookie: skb DMA 功能执行的多种可能 DMA 操作之一的 cookie
  *	@secmark: 安全标记
  *	@vlan_tci: vlan 标签控制信息
@@ -544,6 +587,8 @@ struct sk_buff {
 #endif
 #endif
 
+	__u32			rxhash;    // 接收时计算的流哈希，用于 RPS
+
 	// 标志位字段
 	kmemcheck_bitfield_begin(flags2);	// 开始第二个位字段检查
 	 // 队列映射，用于多队列设备
@@ -552,11 +597,16 @@ struct sk_buff {
 	// 节点类型，用于 IPv6 邻居发现
 	__u8			ndisc_nodetype:2; // 链路层的路由器类型
 #endif
+	__u8			ooo_okay:1;	// 没有在途数据，可重新选择发送队列
+	__u8			head_frag:1;	// 数据区取自页面片段，由 put_page 释放
 	kmemcheck_bitfield_end(flags2);	// 结束使用位字段检查
 
-	/* 0/14 bit hole */
+	/* 0/13 bit hole */
 	// 未使用的位，留作未来使用或对齐
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		napi_id;    // 接收该包的 NAPI 实例 id，用于忙轮询
+#endif
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie; // DMA 操作的标识符，用于追踪 DMA 传输状态
 #endif
@@ -623,8 +673,10 @@ static inline struct rtable *skb_rtable(const struct sk_buff *skb)
 extern void kfree_skb(struct sk_buff *skb);  // 声明用于释放 skb 的函数
 extern void consume_skb(struct sk_buff *skb);  // 声明用于处理并最终释放 skb 的函数
 extern void __kfree_skb(struct sk_buff *skb);  // 声明一个内部使用的释放 skb 的函数
+extern void kfree_skb_partial(struct sk_buff *skb, bool head_stolen);
 extern struct sk_buff *__alloc_skb(unsigned int size,
 				   gfp_t priority, int fclone, int node);
+extern struct sk_buff *build_skb(void *data, unsigned int frag_size);
 // 声明一个用于分配 skb 的函数，参数包括大小、内存分配标志、是否克隆、节点标识
 static inline struct sk_buff *alloc_skb(unsigned int size,
 					gfp_t priority)
@@ -762,6 +814,49 @@ static inline union skb_shared_tx *skb_tx(struct sk_buff *skb)
 	return &skb_shinfo(skb)->tx_flags;	// 返回指向传输标记的指针
 }
 
+extern void sock_zerocopy_callback(struct ubuf_info *uarg, bool success);
+
+// 获取 skb 关联的 MSG_ZEROCOPY 完成状态，没有则返回 NULL
+static inline struct ubuf_info *skb_zcopy(struct sk_buff *skb)
+{
+	bool is_zcopy = skb && skb_shinfo(skb)->tx_flags.dev_zerocopy;
+
+	return is_zcopy ? skb_shinfo(skb)->destructor_arg : NULL;
+}
+
+static inline void sock_zerocopy_get(struct ubuf_info *uarg)
+{
+	atomic_inc(&uarg->refcnt);
+}
+
+static inline void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg && atomic_dec_and_test(&uarg->refcnt))
+		uarg->callback(uarg, uarg->zerocopy);
+}
+
+// 让 skb 引用 uarg，每个共享信息区只能挂一个 uarg
+static inline void skb_zcopy_set(struct sk_buff *skb, struct ubuf_info *uarg)
+{
+	if (uarg && !skb_zcopy(skb)) {
+		sock_zerocopy_get(uarg);
+		skb_shinfo(skb)->destructor_arg = uarg;
+		skb_shinfo(skb)->tx_flags.dev_zerocopy = 1;
+	}
+}
+
+// 释放 skb 对 uarg 的引用；zerocopy 为 false 表示用户数据已被复制
+static inline void skb_zcopy_clear(struct sk_buff *skb, bool zerocopy)
+{
+	struct ubuf_info *uarg = skb_zcopy(skb);
+
+	if (uarg) {
+		uarg->zerocopy = uarg->zerocopy && zerocopy;
+		skb_shinfo(skb)->tx_flags.dev_zerocopy = 0;
+		sock_zerocopy_put(uarg);
+	}
+}
+
 /**
  *	skb_queue_empty - check if a queue is empty
  *	@list: queue head
@@ -2164,6 +2259,8 @@ static inline struct sk_buff *__dev_alloc_skb(unsigned int length,
 
 extern struct sk_buff *dev_alloc_skb(unsigned int length);
 
+extern void *netdev_alloc_frag(unsigned int fragsz);
+
 extern struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 		unsigned int length, gfp_t gfp_mask);
 
@@ -2633,6 +2730,34 @@ extern int	       skb_shift(struct sk_buff *tgt, struct sk_buff *skb,
 // 根据特定的传输特性将 skb 分段，常用于处理 TCP 分段。
 extern struct sk_buff *skb_segment(struct sk_buff *skb, int features);
 
+// MSG_ZEROCOPY 支持：分配完成状态、固定用户页、以及在必要时退回到复制。
+extern struct ubuf_info *sock_zerocopy_realloc(struct sock *sk, size_t size,
+					       struct ubuf_info *uarg);
+extern void	       sock_zerocopy_put_abort(struct ubuf_info *uarg);
+extern int	       skb_zerocopy_add_frags(struct sock *sk,
+					      struct sk_buff *skb,
+					      const u8 __user *from, int length,
+					      struct ubuf_info *uarg);
+extern int	       skb_zerocopy_clone(struct sk_buff *nskb,
+					  struct sk_buff *orig, gfp_t gfp_mask);
+extern int	       skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask);
+
+/**
+ *	skb_orphan_frags - make a local copy of user pages
+ *	@skb: buffer to orphan frags from
+ *	@gfp_mask: allocation mask for replacement pages
+ *
+ *	For buffers that may be held for an unbounded time, e.g. after
+ *	looping back to a local receiver, copy the frags that reference
+ *	MSG_ZEROCOPY user pages so the sender is notified promptly.
+ */
+static inline int skb_orphan_frags(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!skb_zcopy(skb)))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
 // 从 sk_buff 获取指向数据头的指针，如果数据头不在线性区域内，则将数据复制到提供的缓冲区。
 // 这个函数用于安全地访问 skb 中的数据，特别是当数据可能不完全在线性区域时。它首先检查数据是否可以直接访问，如果不可以，则尝试复制到外部缓冲区。
 static inline void *skb_header_pointer(const struct sk_buff *skb, int offset,
@@ -3054,6 +3179,23 @@ static inline bool skb_rx_queue_recorded(const struct sk_buff *skb)
 	return (skb->queue_mapping != 0);	// 检查是否记录了接收队列
 }
 
+extern __u32 __skb_get_rxhash(struct sk_buff *skb);
+
+/**
+ * skb_get_rxhash - 获取 sk_buff 的接收流哈希
+ * @skb: 指向网络数据包的指针
+ *
+ * 若 skb->rxhash 尚未计算，则根据地址和端口计算并缓存。
+ * 返回 0 表示无法计算哈希（非 IP 数据包等）。
+ */
+static inline __u32 skb_get_rxhash(struct sk_buff *skb)
+{
+	if (!skb->rxhash)
+		skb->rxhash = __skb_get_rxhash(skb);	// 首次使用时计算并缓存
+
+	return skb->rxhash;
+}
+
 /**
  * skb_tx_hash - 计算 sk_buff 的传输散列
  * @dev: 网络设备
@@ -29,6 +29,8 @@ struct udphdr {
 /* UDP socket options */
 #define UDP_CORK	1	/* Never send partially complete segments */
 #define UDP_ENCAP	100	/* Set the socket to accept encapsulated packets */
+#define UDP_SEGMENT	103	/* Set GSO segmentation size */
+#define UDP_GRO		104	/* This socket can receive UDP GRO packets */
 
 /* UDP encapsulation types */
 #define UDP_ENCAP_ESPINUDP_NON_IKE	1 /* draft-ietf-ipsec-nat-t-ike-00/01 */
@@ -47,6 +49,9 @@ static inline struct udphdr *udp_hdr(const struct sk_buff *skb)
 
 #define UDP_HTABLE_SIZE_MIN		(CONFIG_BASE_SMALL ? 128 : 256)
 
+/* Upper bound on the number of datagrams in one UDP_SEGMENT send */
+#define UDP_MAX_SEGMENTS		(1 << 6UL)
+
 static inline int udp_hashfn(struct net *net, unsigned num, unsigned mask)
 {
 	return (num + net_hash_mix(net)) & mask;
@@ -76,7 +81,11 @@ struct udp_sock {
 #define UDPLITE_SEND_CC  0x2  		/* set via udplite setsockopt         */
 #define UDPLITE_RECV_CC  0x4		/* set via udplite setsocktopt        */
 	__u8		 pcflag;        /* marks socket as UDP-Lite if > 0    */
-	__u8		 unused[3];
+	__u8		 gro_enabled;	/* accepts coalesced datagrams (UDP_GRO) */
+	/*
+	 * Segment size for UDP segmentation offload, 0 if disabled.
+	 */
+	__u16		 gso_size;
 	/*
 	 * For encapsulation sockets.
 	 */
@@ -0,0 +1,147 @@
+/*
+ * net busy poll support
+ *
+ * Sockets that opt in (SO_BUSY_POLL, or the net.core.busy_read default)
+ * remember which NAPI instance their last packet arrived on.  Rather
+ * than sleep waiting for data, a reader may then spin for a bounded
+ * number of microseconds calling that instance's poll routine directly,
+ * trading CPU time for receive latency.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef _LINUX_NET_BUSY_POLL_H
+#define _LINUX_NET_BUSY_POLL_H
+
+#include <linux/netdevice.h>
+#include <linux/sched.h>
+#include <net/sock.h>
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+extern unsigned int sysctl_net_busy_read __read_mostly;
+extern unsigned int sysctl_net_busy_poll __read_mostly;
+
+/* Packets handed to a driver's poll routine per busy poll iteration */
+#define BUSY_POLL_BUDGET	8
+
+static inline bool net_busy_loop_on(void)
+{
+	return sysctl_net_busy_poll;
+}
+
+static inline bool sk_can_busy_loop(const struct sock *sk)
+{
+	return sk->sk_ll_usec && sk->sk_napi_id && !signal_pending(current);
+}
+
+/* Only deltas are ever compared, so whichever cpu we sample is fine. */
+static inline unsigned long busy_loop_current_time(void)
+{
+	return (unsigned long)(cpu_clock(raw_smp_processor_id()) >> 10);
+}
+
+/* in poll/select we use the global sysctl_net_busy_poll value */
+static inline bool busy_loop_timeout(unsigned long start_time)
+{
+	unsigned long bp_usec = ACCESS_ONCE(sysctl_net_busy_poll);
+
+	return time_after(busy_loop_current_time(), start_time + bp_usec);
+}
+
+/* in recvmsg we use the per socket sk->sk_ll_usec value */
+static inline bool sk_busy_loop_timeout(struct sock *sk,
+					unsigned long start_time)
+{
+	unsigned long bp_usec = ACCESS_ONCE(sk->sk_ll_usec);
+
+	return time_after(busy_loop_current_time(), start_time + bp_usec);
+}
+
+extern void napi_busy_loop(unsigned int napi_id,
+			   bool (*loop_end)(void *, unsigned long),
+			   void *loop_end_arg);
+
+static inline bool sk_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct sock *sk = p;
+
+	return !skb_queue_empty(&sk->sk_receive_queue) ||
+	       sk_busy_loop_timeout(sk, start_time);
+}
+
+/**
+ * sk_busy_loop - poll the NAPI instance feeding @sk
+ * @sk: socket about to wait for data
+ * @nonblock: poll a single time instead of until data or timeout
+ *
+ * Returns true if the receive queue holds data afterwards.
+ */
+static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned int napi_id = ACCESS_ONCE(sk->sk_napi_id);
+
+	if (napi_id)
+		napi_busy_loop(napi_id, nonblock ? NULL : sk_busy_loop_end, sk);
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline bool net_busy_loop_on(void)
+{
+	return false;
+}
+
+static inline bool sk_can_busy_loop(const struct sock *sk)
+{
+	return false;
+}
+
+static inline bool busy_loop_timeout(unsigned long start_time)
+{
+	return true;
+}
+
+static inline unsigned long busy_loop_current_time(void)
+{
+	return 0;
+}
+
+static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	return false;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
+/* used in the NIC receive handler to mark the skb */
+static inline void skb_mark_napi_id(struct sk_buff *skb,
+				    struct napi_struct *napi)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	skb->napi_id = napi->napi_id;
+#endif
+}
+
+/* used in the protocol handler to propagate the napi_id to the socket */
+static inline void sk_mark_napi_id(struct sock *sk, const struct sk_buff *skb)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	sk->sk_napi_id = skb->napi_id;
+#endif
+}
+
+/* variant used for unconnected sockets, fed by more than one queue */
+static inline void sk_mark_napi_id_once(struct sock *sk,
+					const struct sk_buff *skb)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	if (!sk->sk_napi_id)
+		sk->sk_napi_id = skb->napi_id;
+#endif
+}
+
+#endif /* _LINUX_NET_BUSY_POLL_H */
@@ -25,8 +25,7 @@ struct sockaddr;
 extern int inet6_csk_bind_conflict(const struct sock *sk,
 				   const struct inet_bind_bucket *tb);
 
-extern struct request_sock *inet6_csk_search_req(const struct sock *sk,
-						 struct request_sock ***prevp,
+extern struct request_sock *inet6_csk_search_req(struct sock *sk,
 						 const __be16 rport,
 						 const struct in6_addr *raddr,
 						 const struct in6_addr *laddr,
@@ -60,6 +60,7 @@ struct inet_connection_sock_af_ops {
 				char __user *optval, int __user *optlen);
 #endif
 	void	    (*addr2sockaddr)(struct sock *sk, struct sockaddr *);
+	int	    (*recv_error)(struct sock *sk, struct msghdr *msg, int len);
 	int	    (*bind_conflict)(const struct sock *sk,
 				     const struct inet_bind_bucket *tb);
 };
@@ -133,6 +134,8 @@ struct inet_connection_sock {
 #define ICSK_TIME_DACK		2	/* Delayed ack timer */
 #define ICSK_TIME_PROBE0	3	/* Zero window probe timer */
 #define ICSK_TIME_KEEPOPEN	4	/* Keepalive timer */
+#define ICSK_TIME_EARLY_RETRANS 5	/* Early retransmit timer */
+#define ICSK_TIME_LOSS_PROBE	6	/* Tail loss probe timer */
 
 static inline struct inet_connection_sock *inet_csk(const struct sock *sk)
 {
@@ -187,7 +190,8 @@ static inline void inet_csk_clear_xmit_timer(struct sock *sk, const int what)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	
-	if (what == ICSK_TIME_RETRANS || what == ICSK_TIME_PROBE0) {
+	if (what == ICSK_TIME_RETRANS || what == ICSK_TIME_PROBE0 ||
+	    what == ICSK_TIME_EARLY_RETRANS || what == ICSK_TIME_LOSS_PROBE) {
 		icsk->icsk_pending = 0;
 #ifdef INET_CSK_CLEAR_TIMERS
 		sk_stop_timer(sk, &icsk->icsk_retransmit_timer);
@@ -222,7 +226,8 @@ static inline void inet_csk_reset_xmit_timer(struct sock *sk, const int what,
 		when = max_when;
 	}
 
-	if (what == ICSK_TIME_RETRANS || what == ICSK_TIME_PROBE0) {
+	if (what == ICSK_TIME_RETRANS || what == ICSK_TIME_PROBE0 ||
+	    what == ICSK_TIME_EARLY_RETRANS || what == ICSK_TIME_LOSS_PROBE) {
 		icsk->icsk_pending = what;
 		icsk->icsk_timeout = jiffies + when;
 		sk_reset_timer(sk, &icsk->icsk_retransmit_timer, icsk->icsk_timeout);
@@ -240,8 +245,7 @@ static inline void inet_csk_reset_xmit_timer(struct sock *sk, const int what,
 
 extern struct sock *inet_csk_accept(struct sock *sk, int flags, int *err);
 
-extern struct request_sock *inet_csk_search_req(const struct sock *sk,
-						struct request_sock ***prevp,
+extern struct request_sock *inet_csk_search_req(struct sock *sk,
 						const __be16 rport,
 						const __be32 raddr,
 						const __be32 laddr);
@@ -252,28 +256,27 @@ extern int inet_csk_get_port(struct sock *sk, unsigned short snum);
 extern struct dst_entry* inet_csk_route_req(struct sock *sk,
 					    const struct request_sock *req);
 
-static inline void inet_csk_reqsk_queue_add(struct sock *sk,
-					    struct request_sock *req,
-					    struct sock *child)
-{
-	reqsk_queue_add(&inet_csk(sk)->icsk_accept_queue, req, sk, child);
-}
+extern struct sock *inet_csk_reqsk_queue_add(struct sock *sk,
+					     struct request_sock *req,
+					     struct sock *child);
 
 extern void inet_csk_reqsk_queue_hash_add(struct sock *sk,
 					  struct request_sock *req,
 					  unsigned long timeout);
 
-static inline void inet_csk_reqsk_queue_removed(struct sock *sk,
-						struct request_sock *req)
-{
-	if (reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req) == 0)
-		inet_csk_delete_keepalive_timer(sk);
-}
-
+/*
+ * Finish a hash_add once syn_wait_lock is released: @prev_qlen is the
+ * queue length before @req was linked, negative if the listener was
+ * closed in the meantime.
+ */
 static inline void inet_csk_reqsk_queue_added(struct sock *sk,
+					      struct request_sock *req,
+					      const int prev_qlen,
 					      const unsigned long timeout)
 {
-	if (reqsk_queue_added(&inet_csk(sk)->icsk_accept_queue) == 0)
+	if (prev_qlen < 0)
+		reqsk_free(req);
+	else if (prev_qlen == 0)
 		inet_csk_reset_keepalive_timer(sk, timeout);
 }
 
@@ -292,20 +295,21 @@ static inline int inet_csk_reqsk_queue_is_full(const struct sock *sk)
 	return reqsk_queue_is_full(&inet_csk(sk)->icsk_accept_queue);
 }
 
-static inline void inet_csk_reqsk_queue_unlink(struct sock *sk,
-					       struct request_sock *req,
-					       struct request_sock **prev)
-{
-	reqsk_queue_unlink(&inet_csk(sk)->icsk_accept_queue, req, prev);
-}
+extern int inet_csk_reqsk_queue_claim(struct sock *sk,
+				      struct request_sock *req);
+extern void inet_csk_reqsk_queue_unclaim(struct sock *sk,
+					 struct request_sock *req);
+extern int inet_csk_reqsk_queue_unlink(struct sock *sk,
+				       struct request_sock *req);
+extern struct sock *inet_csk_reqsk_queue_complete(struct sock *sk,
+						  struct request_sock *req,
+						  struct sock *child);
 
 static inline void inet_csk_reqsk_queue_drop(struct sock *sk,
-					     struct request_sock *req,
-					     struct request_sock **prev)
+					     struct request_sock *req)
 {
-	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
-	reqsk_free(req);
+	if (inet_csk_reqsk_queue_unlink(sk, req))
+		reqsk_put(req);
 }
 
 extern void inet_csk_reqsk_queue_prune(struct sock *parent,
@@ -314,6 +318,7 @@ extern void inet_csk_reqsk_queue_prune(struct sock *parent,
 				       const unsigned long max_rto);
 
 extern void inet_csk_destroy_sock(struct sock *sk);
+extern void inet_csk_prepare_forced_close(struct sock *sk);
 
 /*
  * LISTEN is a special case for poll..
@@ -106,6 +106,7 @@ struct rtable;
  * @is_icsk - is this an inet_connection_sock?
  * @mc_index - Multicast device index
  * @mc_list - Group array
+ * @rx_dst_ifindex - ifindex the cached sk_rx_dst was received on
  * @cork - info to build ip hdr on each ip frag while socket is corked
  */
 struct inet_sock {
@@ -140,9 +141,11 @@ struct inet_sock {
 	int			mc_index;
 	__be32			mc_addr;
 	struct ip_mc_socklist	*mc_list;
+	int			rx_dst_ifindex;
 	struct {
 		unsigned int		flags;
 		unsigned int		fragsize;
+		__u16			gso_size; /* UDP segment size, 0 if none */
 		struct ip_options	*opt;
 		struct dst_entry	*dst;
 		int			length; /* Total length of all frames */
@@ -54,6 +54,7 @@ struct ipcm_cookie {
 	int			oif;
 	struct ip_options	*opt;
 	union skb_shared_tx	shtx;
+	__u16			gso_size;
 };
 
 #define IPCB(skb) ((struct inet_skb_parm*)((skb)->cb))
@@ -178,6 +179,13 @@ extern unsigned long snmp_fold_field(void __percpu *mib[], int offt);
 extern int snmp_mib_init(void __percpu *ptr[2], size_t mibsize);
 extern void snmp_mib_free(void __percpu *ptr[2]);
 
+/* GRO/GSO for IPv4 carried in IPv4 tunnels, from af_inet.c */
+extern struct sk_buff **inet_encap_gro_receive(struct sk_buff **head,
+					       struct sk_buff *skb);
+extern int inet_encap_gro_complete(struct sk_buff *skb, unsigned int hlen);
+extern struct sk_buff *inet_encap_gso_segment(struct sk_buff *skb,
+					      int features);
+
 extern struct local_ports {
 	seqlock_t	lock;
 	int		range[2];
@@ -186,6 +194,7 @@ extern void inet_get_local_port_range(int *low, int *high);
 
 extern int sysctl_ip_default_ttl;
 extern int sysctl_ip_nonlocal_bind;
+extern int sysctl_ip_early_demux;
 
 extern struct ctl_path net_core_path[];
 extern struct ctl_path net_ipv4_ctl_path[];
@@ -65,14 +65,22 @@ struct request_sock {
 	struct sock			*sk;
 	u32				secid;
 	u32				peer_secid;
+	atomic_t			rsk_refcnt;
+	u32				rsk_hash;	/* syn_table slot */
+	u8				rsk_hashed:1,	/* in the syn_table */
+					rsk_claimed:1;	/* child being created */
 };
 
 static inline struct request_sock *reqsk_alloc(const struct request_sock_ops *ops)
 {
 	struct request_sock *req = kmem_cache_alloc(ops->slab, GFP_ATOMIC);
 
-	if (req != NULL)
+	if (req != NULL) {
 		req->rsk_ops = ops;
+		atomic_set(&req->rsk_refcnt, 1);
+		req->rsk_hashed = 0;
+		req->rsk_claimed = 0;
+	}
 
 	return req;
 }
@@ -88,17 +96,26 @@ static inline void reqsk_free(struct request_sock *req)
 	__reqsk_free(req);
 }
 
+static inline void reqsk_put(struct request_sock *req)
+{
+	if (atomic_dec_and_test(&req->rsk_refcnt))
+		reqsk_free(req);
+}
+
+/* Drop the accept queue's reference: whatever the destructor would free
+ * was handed over to the child socket.
+ */
+static inline void __reqsk_put(struct request_sock *req)
+{
+	if (atomic_dec_and_test(&req->rsk_refcnt))
+		__reqsk_free(req);
+}
+
 extern int sysctl_max_syn_backlog;
 
 /** struct listen_sock - listen state
- *
- * @max_qlen_log - log_2 of maximal queued SYNs/REQUESTs
  */
 struct listen_sock {
-	u8			max_qlen_log;
-	/* 3 bytes hole, try to use */
-	int			qlen;
-	int			qlen_young;
 	int			clock_hand;
 	u32			hash_rnd;
 	u32			nr_table_entries;
@@ -109,25 +126,36 @@ struct listen_sock {
  *
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
+ * @rskq_lock - protects the accept FIFO and the parent's sk_ack_backlog
+ * @syn_wait_lock - protects listen_opt and its syn_table
  * @rskq_defer_accept - User waits for some data after accept()
- * @syn_wait_lock - serializer
- *
- * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
- * lock sock while browsing the listening hash (otherwise it's deadlock prone).
+ * @max_qlen_log - log_2 of maximal queued SYNs/REQUESTs
+ * @qlen - number of requests in the syn_table
+ * @qlen_young - requests whose SYN-ACK was not retransmitted yet
+ * @fastopen_max_qlen - TCP_FASTOPEN limit on children still in SYN_RECV,
+ *	zero when Fast Open is disabled on this listener
+ * @fastopen_qlen - Fast Open children whose 3WHS has not completed yet
  *
- * This lock is acquired in read mode only from listening_get_next() seq_file
- * op and it's acquired in write mode _only_ from code that is actively
- * changing rskq_accept_head. All readers that are holding the master sock lock
- * don't need to grab this lock in read mode too as rskq_accept_head. writes
- * are always protected from the main sock lock.
+ * TCP processes segments for listening sockets without the socket lock,
+ * so both the SYN table and the accept FIFO carry their own locks.
+ * %syn_wait_lock is taken in read mode to look up a request (which is
+ * then returned with a reference held) and by the proc and diag dumpers,
+ * and in write mode to link, unlink or claim one.  The queue lengths are
+ * only written under it, unlocked readers get a good enough estimate.
  */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
 	struct request_sock	*rskq_accept_tail;
+	spinlock_t		rskq_lock;
 	rwlock_t		syn_wait_lock;
 	u8			rskq_defer_accept;
-	/* 3 bytes hole, try to pack */
+	u8			max_qlen_log;
+	/* 2 bytes hole, try to pack */
+	int			qlen;
+	int			qlen_young;
 	struct listen_sock	*listen_opt;
+	int			fastopen_max_qlen;
+	atomic_t		fastopen_qlen;
 };
 
 extern int reqsk_queue_alloc(struct request_sock_queue *queue,
@@ -139,9 +167,13 @@ extern void reqsk_queue_destroy(struct request_sock_queue *queue);
 static inline struct request_sock *
 	reqsk_queue_yank_acceptq(struct request_sock_queue *queue)
 {
-	struct request_sock *req = queue->rskq_accept_head;
+	struct request_sock *req;
 
+	spin_lock_bh(&queue->rskq_lock);
+	req = queue->rskq_accept_head;
 	queue->rskq_accept_head = NULL;
+	queue->rskq_accept_tail = NULL;
+	spin_unlock_bh(&queue->rskq_lock);
 	return req;
 }
 
@@ -150,15 +182,20 @@ static inline int reqsk_queue_empty(struct request_sock_queue *queue)
 	return queue->rskq_accept_head == NULL;
 }
 
+/* Caller holds syn_wait_lock for writing */
 static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
-				      struct request_sock *req,
-				      struct request_sock **prev_req)
+				      struct request_sock *req)
 {
-	write_lock(&queue->syn_wait_lock);
-	*prev_req = req->dl_next;
-	write_unlock(&queue->syn_wait_lock);
+	struct request_sock **prev;
+
+	prev = &queue->listen_opt->syn_table[req->rsk_hash];
+	while (*prev != req)
+		prev = &(*prev)->dl_next;
+	*prev = req->dl_next;
+	req->rsk_hashed = 0;
 }
 
+/* Caller holds rskq_lock */
 static inline void reqsk_queue_add(struct request_sock_queue *queue,
 				   struct request_sock *req,
 				   struct sock *parent,
@@ -192,52 +229,59 @@ static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue
 static inline struct sock *reqsk_queue_get_child(struct request_sock_queue *queue,
 						 struct sock *parent)
 {
-	struct request_sock *req = reqsk_queue_remove(queue);
-	struct sock *child = req->sk;
+	struct request_sock *req;
+	struct sock *child;
+
+	spin_lock_bh(&queue->rskq_lock);
+	req = reqsk_queue_remove(queue);
+	sk_acceptq_removed(parent);
+	spin_unlock_bh(&queue->rskq_lock);
 
+	child = req->sk;
 	WARN_ON(child == NULL);
 
-	sk_acceptq_removed(parent);
-	__reqsk_free(req);
+	__reqsk_put(req);
 	return child;
 }
 
+/* Caller holds syn_wait_lock for writing */
 static inline int reqsk_queue_removed(struct request_sock_queue *queue,
 				      struct request_sock *req)
 {
-	struct listen_sock *lopt = queue->listen_opt;
-
 	if (req->retrans == 0)
-		--lopt->qlen_young;
+		--queue->qlen_young;
 
-	return --lopt->qlen;
+	return --queue->qlen;
 }
 
+/* Caller holds syn_wait_lock for writing */
 static inline int reqsk_queue_added(struct request_sock_queue *queue)
 {
-	struct listen_sock *lopt = queue->listen_opt;
-	const int prev_qlen = lopt->qlen;
+	const int prev_qlen = queue->qlen;
 
-	lopt->qlen_young++;
-	lopt->qlen++;
+	queue->qlen_young++;
+	queue->qlen++;
 	return prev_qlen;
 }
 
 static inline int reqsk_queue_len(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt != NULL ? queue->listen_opt->qlen : 0;
+	return queue->listen_opt != NULL ? queue->qlen : 0;
 }
 
 static inline int reqsk_queue_len_young(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen_young;
+	return queue->qlen_young;
 }
 
 static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
+	return queue->qlen >> queue->max_qlen_log;
 }
 
+/* Caller holds syn_wait_lock for writing, the syn_table now owns the
+ * reference to @req.
+ */
 static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
 					u32 hash, struct request_sock *req,
 					unsigned long timeout)
@@ -247,11 +291,10 @@ static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
 	req->expires = jiffies + timeout;
 	req->retrans = 0;
 	req->sk = NULL;
+	req->rsk_hash = hash;
+	req->rsk_hashed = 1;
 	req->dl_next = lopt->syn_table[hash];
-
-	write_lock(&queue->syn_wait_lock);
 	lopt->syn_table[hash] = req;
-	write_unlock(&queue->syn_wait_lock);
 }
 
 #endif /* _REQUEST_SOCK_H */
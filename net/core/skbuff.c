@@ -240,6 +240,142 @@ nodata:
 }
 EXPORT_SYMBOL(__alloc_skb);
 
+/**
+ *	build_skb - build a network buffer
+ *	@data: data buffer provided by caller
+ *	@frag_size: size of fragment, or 0 if head was kmalloced
+ *
+ *	Allocate a new &sk_buff around an already allocated data buffer,
+ *	so that drivers can DMA into plain buffers and only need an
+ *	sk_buff once a frame was received.  @data must have room for the
+ *	skb_shared_info at its end, that is @frag_size (or ksize(@data))
+ *	minus SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) bytes are
+ *	available for the frame.  A @frag_size makes the buffer a page
+ *	fragment, freed with put_page() on its head page.
+ *
+ *	The return is the buffer.  On a failure the return is %NULL and
+ *	@data is left to the caller.
+ */
+struct sk_buff *build_skb(void *data, unsigned int frag_size)
+{
+	struct skb_shared_info *shinfo;
+	struct sk_buff *skb;
+	unsigned int size = frag_size ? : ksize(data);
+
+	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+	if (!skb)
+		return NULL;
+
+	size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+	skb->truesize = size + sizeof(struct sk_buff);
+	skb->head_frag = frag_size != 0;
+	atomic_set(&skb->users, 1);
+	skb->head = data;
+	skb->data = data;
+	skb_reset_tail_pointer(skb);
+	skb->end = skb->tail + size;
+	kmemcheck_annotate_bitfield(skb, flags1);
+	kmemcheck_annotate_bitfield(skb, flags2);
+#ifdef NET_SKBUFF_DATA_USES_OFFSET
+	skb->mac_header = ~0U;
+#endif
+
+	shinfo = skb_shinfo(skb);
+	atomic_set(&shinfo->dataref, 1);
+	shinfo->nr_frags  = 0;
+	shinfo->gso_size = 0;
+	shinfo->gso_segs = 0;
+	shinfo->gso_type = 0;
+	shinfo->ip6_frag_id = 0;
+	shinfo->tx_flags.flags = 0;
+	skb_frag_list_init(skb);
+	memset(&shinfo->hwtstamps, 0, sizeof(shinfo->hwtstamps));
+
+	return skb;
+}
+EXPORT_SYMBOL(build_skb);
+
+/*
+ * Receive buffers are carved out of per-cpu high-order pages.  The page
+ * refcount is charged NETDEV_PAGECNT_MAX_BIAS up front and pagecnt_bias
+ * counts what is left of that charge, so handing out a fragment costs no
+ * atomic operation.  Once the page is used up, it is recycled right away
+ * if all its fragments were freed already.
+ */
+struct netdev_alloc_cache {
+	struct page	*page;
+	unsigned int	size;
+	unsigned int	offset;
+	unsigned int	pagecnt_bias;
+};
+static DEFINE_PER_CPU(struct netdev_alloc_cache, netdev_alloc_cache);
+
+#define NETDEV_FRAG_PAGE_MAX_ORDER get_order(32768)
+#define NETDEV_FRAG_PAGE_MAX_SIZE  (PAGE_SIZE << NETDEV_FRAG_PAGE_MAX_ORDER)
+#define NETDEV_PAGECNT_MAX_BIAS	   NETDEV_FRAG_PAGE_MAX_SIZE
+
+static void *__netdev_alloc_frag(unsigned int fragsz, gfp_t gfp_mask)
+{
+	struct netdev_alloc_cache *nc;
+	void *data = NULL;
+	unsigned long flags;
+	int order;
+
+	local_irq_save(flags);
+	nc = &__get_cpu_var(netdev_alloc_cache);
+	if (unlikely(!nc->page)) {
+refill:
+		for (order = NETDEV_FRAG_PAGE_MAX_ORDER; ;) {
+			gfp_t gfp = gfp_mask;
+
+			if (order)
+				gfp |= __GFP_COMP | __GFP_NOWARN | __GFP_NORETRY;
+			nc->page = alloc_pages(gfp, order);
+			if (likely(nc->page))
+				break;
+			if (--order < 0)
+				goto end;
+		}
+		nc->size = PAGE_SIZE << order;
+recycle:
+		atomic_set(&nc->page->_count, NETDEV_PAGECNT_MAX_BIAS);
+		nc->pagecnt_bias = NETDEV_PAGECNT_MAX_BIAS;
+		nc->offset = 0;
+	}
+
+	if (nc->offset + fragsz > nc->size) {
+		/* Avoid the locked operation if nobody else holds a fragment */
+		if (atomic_read(&nc->page->_count) == nc->pagecnt_bias ||
+		    atomic_sub_and_test(nc->pagecnt_bias, &nc->page->_count))
+			goto recycle;
+		goto refill;
+	}
+
+	data = page_address(nc->page) + nc->offset;
+	nc->offset += fragsz;
+	nc->pagecnt_bias--;
+end:
+	local_irq_restore(flags);
+	return data;
+}
+
+/**
+ *	netdev_alloc_frag - allocate a page fragment
+ *	@fragsz: fragment size
+ *
+ *	Allocates a receive buffer from a per-cpu page, to be used with
+ *	build_skb() or as a page fragment.  It is freed with put_page() on
+ *	virt_to_head_page() of the returned address.  %NULL is returned if
+ *	there is no free memory.
+ */
+void *netdev_alloc_frag(unsigned int fragsz)
+{
+	return __netdev_alloc_frag(fragsz, GFP_ATOMIC | __GFP_COLD);
+}
+EXPORT_SYMBOL(netdev_alloc_frag);
+
 /**
  *	__netdev_alloc_skb - allocate an skbuff for rx on a specific device
  *	@dev: network device to receive on
@@ -257,9 +393,23 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 		unsigned int length, gfp_t gfp_mask)
 {
 	int node = dev->dev.parent ? dev_to_node(dev->dev.parent) : -1;
+	unsigned int fragsz = SKB_DATA_ALIGN(length + NET_SKB_PAD) +
+			      SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 	struct sk_buff *skb;
 
-	skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
+	if (fragsz <= PAGE_SIZE && !(gfp_mask & (__GFP_WAIT | GFP_DMA))) {
+		void *data = __netdev_alloc_frag(fragsz, gfp_mask);
+
+		if (likely(data)) {
+			skb = build_skb(data, fragsz);
+			if (unlikely(!skb))
+				put_page(virt_to_head_page(data));
+		} else {
+			skb = NULL;
+		}
+	} else {
+		skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
+	}
 	if (likely(skb)) {
 		skb_reserve(skb, NET_SKB_PAD);
 		skb->dev = dev;
@@ -336,6 +486,14 @@ static void skb_clone_fraglist(struct sk_buff *skb)
 		skb_get(list);
 }
 
+static void skb_free_head(struct sk_buff *skb)
+{
+	if (skb->head_frag)
+		put_page(virt_to_head_page(skb->head));
+	else
+		kfree(skb->head);
+}
+
 static void skb_release_data(struct sk_buff *skb)
 {
 	if (!skb->cloned ||
@@ -347,10 +505,12 @@ static void skb_release_data(struct sk_buff *skb)
 				put_page(skb_shinfo(skb)->frags[i].page);
 		}
 
+		skb_zcopy_clear(skb, true);
+
 		if (skb_has_frags(skb))
 			skb_drop_fraglist(skb);
 
-		kfree(skb->head);
+		skb_free_head(skb);
 	}
 }
 
@@ -477,6 +637,24 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+/**
+ *	kfree_skb_partial - free an sk_buff whose head may have been stolen
+ *	@skb: buffer to free
+ *	@head_stolen: the head and its page fragments now belong to another skb
+ *
+ *	Only the caller may hold a reference to @skb.
+ */
+void kfree_skb_partial(struct sk_buff *skb, bool head_stolen)
+{
+	if (head_stolen) {
+		skb_release_head_state(skb);
+		kfree_skbmem(skb);
+	} else {
+		__kfree_skb(skb);
+	}
+}
+EXPORT_SYMBOL(kfree_skb_partial);
+
 /**
  *	skb_recycle_check - check if skb can be reused for receive
  *	@skb: buffer
@@ -492,6 +670,7 @@ EXPORT_SYMBOL(consume_skb);
 int skb_recycle_check(struct sk_buff *skb, int skb_size)
 {
 	struct skb_shared_info *shinfo;
+	u8 head_frag;
 
 	if (irqs_disabled())
 		return 0;
@@ -518,7 +697,9 @@ int skb_recycle_check(struct sk_buff *skb, int skb_size)
 	skb_frag_list_init(skb);
 	memset(&shinfo->hwtstamps, 0, sizeof(shinfo->hwtstamps));
 
+	head_frag = skb->head_frag;
 	memset(skb, 0, offsetof(struct sk_buff, tail));
+	skb->head_frag = head_frag;
 	skb->data = skb->head + NET_SKB_PAD;
 	skb_reset_tail_pointer(skb);
 
@@ -543,6 +724,10 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->pkt_type		= old->pkt_type;
 	new->ip_summed		= old->ip_summed;
 	skb_copy_queue_mapping(new, old);
+	new->rxhash		= old->rxhash;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	new->napi_id		= old->napi_id;
+#endif
 	new->priority		= old->priority;
 #if defined(CONFIG_IP_VS) || defined(CONFIG_IP_VS_MODULE)
 	new->ipvs_property	= old->ipvs_property;
@@ -588,6 +773,7 @@ static struct sk_buff *__skb_clone(struct sk_buff *n, struct sk_buff *skb)
 	C(tail);
 	C(end);
 	C(head);
+	C(head_frag);
 	C(data);
 	C(truesize);
 	atomic_set(&n->users, 1);
@@ -768,6 +954,7 @@ struct sk_buff *pskb_copy(struct sk_buff *skb, gfp_t gfp_mask)
 			get_page(skb_shinfo(n)->frags[i].page);
 		}
 		skb_shinfo(n)->nr_frags = i;
+		skb_zcopy_set(n, skb_zcopy(skb));
 	}
 
 	if (skb_has_frags(skb)) {
@@ -833,6 +1020,10 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 		get_page(skb_shinfo(skb)->frags[i].page);
 
+	/* the copied shared info references the same user pages */
+	if (skb_zcopy(skb))
+		sock_zerocopy_get(skb_zcopy(skb));
+
 	if (skb_has_frags(skb))
 		skb_clone_fraglist(skb);
 
@@ -841,6 +1032,7 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 	off = (data + nhead) - skb->head;
 
 	skb->head     = data;
+	skb->head_frag = 0;
 	skb->data    += off;
 #ifdef NET_SKBUFF_DATA_USES_OFFSET
 	skb->end      = size;
@@ -2084,6 +2276,7 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 {
 	int pos = skb_headlen(skb);
 
+	skb_zerocopy_clone(skb1, skb, 0);
 	if (len < pos)	/* Split line is inside header. */
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
@@ -2126,6 +2319,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* frags of a MSG_ZEROCOPY skb must stay with its completion */
+	if (skb_zcopy(tgt) || skb_zcopy(skb))
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -2510,6 +2707,8 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 	unsigned int mss = skb_shinfo(skb)->gso_size;
 	unsigned int doffset = skb->data - skb_mac_header(skb);
 	unsigned int offset = doffset;
+	unsigned int nhoff = skb_network_header(skb) - skb_mac_header(skb);
+	unsigned int thoff = skb_transport_header(skb) - skb_mac_header(skb);
 	unsigned int headroom;
 	unsigned int len;
 	int sg = features & NETIF_F_SG;
@@ -2578,10 +2777,12 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 		__copy_skb_header(nskb, skb);
 		nskb->mac_len = skb->mac_len;
 
+		/* Behind a tunnel the headers being segmented are not the
+		 * ones right after the MAC header, keep their offsets.
+		 */
 		skb_reset_mac_header(nskb);
-		skb_set_network_header(nskb, skb->mac_len);
-		nskb->transport_header = (nskb->network_header +
-					  skb_network_header_len(skb));
+		skb_set_network_header(nskb, nhoff);
+		skb_set_transport_header(nskb, thoff);
 		skb_copy_from_linear_data(skb, nskb->data, doffset);
 
 		if (fskb != skb_shinfo(skb)->frag_list)
@@ -2597,6 +2798,9 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 
 		frag = skb_shinfo(nskb)->frags;
 
+		if (unlikely(skb_zerocopy_clone(nskb, skb, GFP_ATOMIC)))
+			goto err;
+
 		skb_copy_from_linear_data_offset(skb, offset,
 						 skb_put(nskb, hsize), hsize);
 
@@ -2702,7 +2906,33 @@ int skb_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 		skb->len -= skb->data_len;
 		skb->data_len = 0;
 
-		NAPI_GRO_CB(skb)->free = 1;
+		NAPI_GRO_CB(skb)->free = NAPI_GRO_FREE;
+		goto done;
+	} else if (skb->head_frag && !skb_cloned(skb)) {
+		/* Turn the page fragment holding the head into a frag of p,
+		 * instead of chaining skb on p's frag_list.
+		 */
+		int nr_frags = pinfo->nr_frags;
+		skb_frag_t *frag = pinfo->frags + nr_frags;
+		struct page *page = virt_to_head_page(skb->head);
+
+		if (nr_frags + 1 + skbinfo->nr_frags > MAX_SKB_FRAGS)
+			return -E2BIG;
+
+		pinfo->nr_frags = nr_frags + 1 + skbinfo->nr_frags;
+
+		frag->page = page;
+		frag->page_offset = skb->data - (u8 *)page_address(page) +
+				    offset;
+		frag->size = headlen - offset;
+
+		/* skb keeps its now stale nr_frags, its shared info goes
+		 * away with the head.
+		 */
+		memcpy(frag + 1, skbinfo->frags,
+		       sizeof(*frag) * skbinfo->nr_frags);
+
+		NAPI_GRO_CB(skb)->free = NAPI_GRO_FREE_STOLEN_HEAD;
 		goto done;
 	} else if (skb_gro_len(p) != pinfo->gso_size)
 		return -E2BIG;
@@ -3008,6 +3238,312 @@ void skb_tstamp_tx(struct sk_buff *orig_skb,
 }
 EXPORT_SYMBOL_GPL(skb_tstamp_tx);
 
+/*
+ * MSG_ZEROCOPY
+ *
+ * User pages are pinned into skb frags instead of being copied.  The
+ * completion state (struct ubuf_info) sits in the cb[] of an skb charged
+ * to the socket's option memory; when the last skb referencing the pages
+ * is freed that skb is queued on sk_error_queue, telling the application
+ * the range of sends [ee_info, ee_data] whose buffers may be reused.
+ */
+
+static inline struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+static struct ubuf_info *sock_zerocopy_alloc(struct sock *sk, size_t size)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	skb = sock_omalloc(sk, 0, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+	uarg = (void *)skb->cb;
+
+	uarg->callback = sock_zerocopy_callback;
+	uarg->id = ((u32)atomic_inc_return(&sk->sk_zckey)) - 1;
+	uarg->len = 1;
+	uarg->bytelen = size;
+	uarg->zerocopy = 1;
+	atomic_set(&uarg->refcnt, 1);
+	sock_hold(sk);
+
+	return uarg;
+}
+
+/**
+ *	sock_zerocopy_realloc - get completion state for a MSG_ZEROCOPY send
+ *	@sk: socket, locked by the caller
+ *	@size: bytes in this send
+ *	@uarg: completion state of the skb the data will be appended to
+ *
+ *	Consecutive sends that land in the same skb share one notification
+ *	whose range is extended, keeping both the error queue and the
+ *	option memory footprint small.  Returns with a reference held,
+ *	or NULL if the socket is out of option memory.
+ */
+struct ubuf_info *sock_zerocopy_realloc(struct sock *sk, size_t size,
+					struct ubuf_info *uarg)
+{
+	if (uarg) {
+		const u32 byte_limit = 1 << 19;		/* limit to a few TSO */
+		u32 bytelen, next;
+
+		bytelen = uarg->bytelen + size;
+		if (uarg->len == USHORT_MAX - 1 || bytelen > byte_limit)
+			goto new_alloc;
+
+		next = (u32)atomic_read(&sk->sk_zckey);
+		if ((u32)(uarg->id + uarg->len) == next) {
+			uarg->len++;
+			uarg->bytelen = bytelen;
+			atomic_set(&sk->sk_zckey, ++next);
+			sock_zerocopy_get(uarg);
+			return uarg;
+		}
+	}
+
+new_alloc:
+	return sock_zerocopy_alloc(sk, size);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_realloc);
+
+static bool skb_zerocopy_notify_extend(struct sk_buff *skb, u32 lo, u16 len)
+{
+	struct sock_exterr_skb *serr = SKB_EXT_ERR(skb);
+	u32 old_lo, old_hi;
+	u64 sum_len;
+
+	old_lo = serr->ee.ee_info;
+	old_hi = serr->ee.ee_data;
+	sum_len = old_hi - old_lo + 1ULL + len;
+
+	if (sum_len >= (1ULL << 32))
+		return false;
+
+	if (lo != old_hi + 1)
+		return false;
+
+	serr->ee.ee_data += len;
+	return true;
+}
+
+void sock_zerocopy_callback(struct ubuf_info *uarg, bool success)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock_exterr_skb *serr;
+	struct sock *sk = skb->sk;
+	struct sk_buff_head *q;
+	unsigned long flags;
+	u32 lo, hi;
+	u16 len;
+
+	/* if !len, there was only 1 call, and it was aborted
+	 * so do not queue a completion notification
+	 */
+	if (!uarg->len || sock_flag(sk, SOCK_DEAD))
+		goto release;
+
+	len = uarg->len;
+	lo = uarg->id;
+	hi = uarg->id + len - 1;
+
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_data = hi;
+	serr->ee.ee_info = lo;
+	if (!success)
+		serr->ee.ee_code |= SO_EE_CODE_ZEROCOPY_COPIED;
+
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (!tail || SKB_EXT_ERR(tail)->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+	    SKB_EXT_ERR(tail)->ee.ee_code != serr->ee.ee_code ||
+	    !skb_zerocopy_notify_extend(tail, lo, len)) {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+
+release:
+	consume_skb(skb);
+	sock_put(sk);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+/**
+ *	sock_zerocopy_put_abort - drop a send that queued no data
+ *	@uarg: completion state returned by sock_zerocopy_realloc()
+ *
+ *	Gives back the notification id taken for a send that failed before
+ *	any byte was queued.
+ */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	if (uarg) {
+		struct sock *sk = skb_from_uarg(uarg)->sk;
+
+		atomic_dec(&sk->sk_zckey);
+		uarg->len--;
+
+		sock_zerocopy_put(uarg);
+	}
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/**
+ *	skb_zerocopy_add_frags - pin user memory into skb frags
+ *	@sk: stream socket the skb is queued on
+ *	@skb: buffer to extend
+ *	@from: user address
+ *	@length: bytes wanted
+ *	@uarg: completion state the pages are accounted to
+ *
+ *	Returns the number of bytes added, -EMSGSIZE if @skb has no free
+ *	frag slot, -EEXIST if @skb already belongs to another completion
+ *	or -EFAULT if nothing could be pinned.  Memory is charged to the
+ *	socket by page, as that is what stays pinned.
+ */
+int skb_zerocopy_add_frags(struct sock *sk, struct sk_buff *skb,
+			   const u8 __user *from, int length,
+			   struct ubuf_info *uarg)
+{
+	struct ubuf_info *orig_uarg = skb_zcopy(skb);
+	struct page *pages[MAX_SKB_FRAGS];
+	int frag = skb_shinfo(skb)->nr_frags;
+	unsigned long start = (unsigned long)from;
+	int off = start & ~PAGE_MASK;
+	int n, npages, copied = 0;
+	unsigned int truesize;
+
+	/* An skb can only point to one uarg */
+	if (orig_uarg && uarg != orig_uarg)
+		return -EEXIST;
+	if (frag == MAX_SKB_FRAGS)
+		return -EMSGSIZE;
+
+	npages = min_t(int, PAGE_ALIGN(off + length) >> PAGE_SHIFT,
+		       MAX_SKB_FRAGS - frag);
+	npages = get_user_pages_fast(start & PAGE_MASK, npages, 0, pages);
+	if (npages <= 0)
+		return -EFAULT;
+
+	for (n = 0; n < npages; n++) {
+		int size = min_t(int, length - copied, PAGE_SIZE - off);
+
+		skb_fill_page_desc(skb, frag++, pages[n], off, size);
+		copied += size;
+		off = 0;
+	}
+
+	truesize = npages << PAGE_SHIFT;
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += truesize;
+	sk->sk_wmem_queued += truesize;
+	sk_mem_charge(sk, truesize);
+
+	skb_zcopy_set(skb, uarg);
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_add_frags);
+
+/**
+ *	skb_zerocopy_clone - share MSG_ZEROCOPY state with a new buffer
+ *	@nskb: buffer that received frags of @orig
+ *	@orig: source buffer
+ *	@gfp_mask: allocation mask, 0 if @nskb is known to have no state
+ */
+int skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig,
+		       gfp_t gfp_mask)
+{
+	if (skb_zcopy(orig)) {
+		if (skb_zcopy(nskb)) {
+			/* !gfp_mask callers are verified to !skb_zcopy(nskb) */
+			if (!gfp_mask) {
+				WARN_ON_ONCE(1);
+				return -ENOMEM;
+			}
+			if (skb_zcopy(nskb) == skb_zcopy(orig))
+				return 0;
+			if (skb_copy_ubufs(nskb, gfp_mask))
+				return -EIO;
+		}
+		skb_zcopy_set(nskb, skb_zcopy(orig));
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_clone);
+
+/**
+ *	skb_copy_ubufs - copy MSG_ZEROCOPY user pages into kernel pages
+ *	@skb: buffer to detach from user memory
+ *	@gfp_mask: allocation priority
+ *
+ *	Replaces every frag of @skb by a private copy and completes its
+ *	reference on the notification, flagged as copied.  A cloned @skb
+ *	gets a private shared info first, the clones keep the user pages.
+ */
+int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	int num_frags = skb_shinfo(skb)->nr_frags;
+	struct page *page, *head = NULL;
+	int i;
+
+	if (!skb_zcopy(skb))
+		return 0;
+
+	if (skb_shared(skb) ||
+	    (skb_cloned(skb) && pskb_expand_head(skb, 0, 0, gfp_mask)))
+		return -EINVAL;
+
+	for (i = 0; i < num_frags; i++) {
+		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
+		u8 *vaddr;
+
+		page = alloc_page(gfp_mask);
+		if (!page) {
+			while (head) {
+				struct page *next = (struct page *)head->private;
+
+				put_page(head);
+				head = next;
+			}
+			return -ENOMEM;
+		}
+		vaddr = kmap_skb_frag(f);
+		memcpy(page_address(page), vaddr + f->page_offset, f->size);
+		kunmap_skb_frag(vaddr);
+		set_page_private(page, (unsigned long)head);
+		head = page;
+	}
+
+	/* skb frags release userspace buffers */
+	for (i = 0; i < num_frags; i++)
+		put_page(skb_shinfo(skb)->frags[i].page);
+
+	/* skb frags point to kernel buffers */
+	for (i = num_frags - 1; i >= 0; i--) {
+		skb_shinfo(skb)->frags[i].page = head;
+		skb_shinfo(skb)->frags[i].page_offset = 0;
+		head = (struct page *)head->private;
+	}
+
+	skb_zcopy_clear(skb, false);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_copy_ubufs);
+
 
 /**
  * skb_partial_csum_set - set up and verify partial csum values for packet
@@ -125,6 +125,7 @@
 #include <linux/ipsec.h>
 
 #include <linux/filter.h>
+#include <net/busy_poll.h>
 
 #ifdef CONFIG_INET
 #include <net/tcp.h>
@@ -497,6 +498,9 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 	case SO_REUSEADDR:
 		sk->sk_reuse = valbool;
 		break;
+	case SO_REUSEPORT:
+		sk->sk_reuseport = valbool;
+		break;
 	case SO_TYPE:
 	case SO_PROTOCOL:
 	case SO_DOMAIN:
@@ -724,6 +728,39 @@ set_rcvbuf:
 		else
 			sock_reset_flag(sk, SOCK_RXQ_OVFL);
 		break;
+
+	case SO_ZEROCOPY:
+		if (sk->sk_family != PF_INET && sk->sk_family != PF_INET6)
+			ret = -ENOTSUPP;
+		else if (sk->sk_protocol != IPPROTO_TCP)
+			ret = -ENOTSUPP;
+		else if (val < 0 || val > 1)
+			ret = -EINVAL;
+		else if (valbool)
+			sock_set_flag(sk, SOCK_ZEROCOPY);
+		else
+			sock_reset_flag(sk, SOCK_ZEROCOPY);
+		break;
+
+	case SO_MAX_PACING_RATE:
+		sk->sk_max_pacing_rate = val;
+		sk->sk_pacing_rate = min(sk->sk_pacing_rate,
+					 sk->sk_max_pacing_rate);
+		break;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	case SO_BUSY_POLL:
+		/* allow unprivileged users to decrease the value */
+		if ((val > sk->sk_ll_usec) && !capable(CAP_NET_ADMIN))
+			ret = -EPERM;
+		else {
+			if (val < 0)
+				ret = -EINVAL;
+			else
+				sk->sk_ll_usec = val;
+		}
+		break;
+#endif
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -780,6 +817,10 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = sk->sk_reuse;
 		break;
 
+	case SO_REUSEPORT:
+		v.val = sk->sk_reuseport;
+		break;
+
 	case SO_KEEPALIVE:
 		v.val = !!sock_flag(sk, SOCK_KEEPOPEN);
 		break;
@@ -927,6 +968,20 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = !!sock_flag(sk, SOCK_RXQ_OVFL);
 		break;
 
+	case SO_ZEROCOPY:
+		v.val = sock_flag(sk, SOCK_ZEROCOPY);
+		break;
+
+	case SO_MAX_PACING_RATE:
+		v.val = sk->sk_max_pacing_rate;
+		break;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	case SO_BUSY_POLL:
+		v.val = sk->sk_ll_usec;
+		break;
+#endif
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1151,6 +1206,7 @@ struct sock *sk_clone(const struct sock *sk, const gfp_t priority)
 		 */
 		atomic_set(&newsk->sk_wmem_alloc, 1);
 		atomic_set(&newsk->sk_omem_alloc, 0);
+		atomic_set(&newsk->sk_zckey, 0);
 		skb_queue_head_init(&newsk->sk_receive_queue);
 		skb_queue_head_init(&newsk->sk_write_queue);
 #ifdef CONFIG_NET_DMA
@@ -1350,6 +1406,37 @@ struct sk_buff *sock_rmalloc(struct sock *sk, unsigned long size, int force,
 	return NULL;
 }
 
+static void sock_ofree(struct sk_buff *skb)
+{
+	struct sock *sk = skb->sk;
+
+	atomic_sub(skb->truesize, &sk->sk_omem_alloc);
+}
+
+/*
+ * Allocate an skb charged to the socket's option memory, for kernel
+ * generated control traffic such as MSG_ZEROCOPY notifications.
+ */
+struct sk_buff *sock_omalloc(struct sock *sk, unsigned long size,
+			     gfp_t priority)
+{
+	struct sk_buff *skb;
+
+	/* small safe race: the estimate may differ from the final truesize */
+	if (atomic_read(&sk->sk_omem_alloc) + size + sizeof(struct sk_buff) >
+	    sysctl_optmem_max)
+		return NULL;
+
+	skb = alloc_skb(size, priority);
+	if (!skb)
+		return NULL;
+
+	atomic_add(skb->truesize, &sk->sk_omem_alloc);
+	skb->sk = sk;
+	skb->destructor = sock_ofree;
+	return skb;
+}
+
 /*
  * Allocate a memory block from the socket's option memory buffer.
  */
@@ -1579,6 +1666,57 @@ int sk_wait_data(struct sock *sk, long *timeo)
 }
 EXPORT_SYMBOL(sk_wait_data);
 
+/*
+ * memory_allocated is a percpu_counter, so that charging and uncharging
+ * protocol memory does not bounce one cache line between all cpus.  Like
+ * the other percpu_counters of struct proto it must be updated with BHs
+ * disabled.
+ */
+static inline void sk_memory_allocated_add(struct proto *prot, int amt)
+{
+	local_bh_disable();
+	percpu_counter_add(prot->memory_allocated, amt);
+	local_bh_enable();
+}
+
+static inline void sk_memory_allocated_sub(struct proto *prot, int amt)
+{
+	sk_memory_allocated_add(prot, -amt);
+}
+
+/**
+ *	proto_memory_cmp - compare the memory charged to a protocol to a limit
+ *	@prot: protocol
+ *	@limit: limit in pages, usually one of prot->sysctl_mem[]
+ *
+ *	Returns 1, 0 or -1 as the memory charged is above, at or below @limit.
+ *	The global count of memory_allocated lags behind by up to
+ *	percpu_counter_batch pages per online cpu.  That is precise enough
+ *	as long as it is further than that from @limit.  Only closer to it
+ *	the per-cpu deltas are summed up, so that memory pressure starts
+ *	and ends where it does with an exact counter.
+ */
+int proto_memory_cmp(struct proto *prot, long limit)
+{
+	struct percpu_counter *fbc = prot->memory_allocated;
+	long allocated = percpu_counter_read(fbc);
+#ifdef CONFIG_SMP
+	long error = (long)percpu_counter_batch * num_online_cpus();
+
+	if (abs(allocated - limit) <= error) {
+		local_bh_disable();
+		allocated = percpu_counter_sum(fbc);
+		local_bh_enable();
+	}
+#endif
+	if (allocated > limit)
+		return 1;
+	if (allocated < limit)
+		return -1;
+	return 0;
+}
+EXPORT_SYMBOL(proto_memory_cmp);
+
 /**
  *	__sk_mem_schedule - increase sk_forward_alloc and memory_allocated
  *	@sk: socket
@@ -1593,25 +1731,24 @@ int __sk_mem_schedule(struct sock *sk, int size, int kind)
 {
 	struct proto *prot = sk->sk_prot;
 	int amt = sk_mem_pages(size);
-	int allocated;
 
 	sk->sk_forward_alloc += amt * SK_MEM_QUANTUM;
-	allocated = atomic_add_return(amt, prot->memory_allocated);
+	sk_memory_allocated_add(prot, amt);
 
 	/* Under limit. */
-	if (allocated <= prot->sysctl_mem[0]) {
+	if (proto_memory_cmp(prot, prot->sysctl_mem[0]) <= 0) {
 		if (prot->memory_pressure && *prot->memory_pressure)
 			*prot->memory_pressure = 0;
 		return 1;
 	}
 
 	/* Under pressure. */
-	if (allocated > prot->sysctl_mem[1])
+	if (proto_memory_cmp(prot, prot->sysctl_mem[1]) > 0)
 		if (prot->enter_memory_pressure)
 			prot->enter_memory_pressure(sk);
 
 	/* Over hard limit. */
-	if (allocated > prot->sysctl_mem[2])
+	if (proto_memory_cmp(prot, prot->sysctl_mem[2]) > 0)
 		goto suppress_allocation;
 
 	/* guarantee minimum buffer size under pressure */
@@ -1654,7 +1791,7 @@ suppress_allocation:
 
 	/* Alas. Undo changes. */
 	sk->sk_forward_alloc -= amt * SK_MEM_QUANTUM;
-	atomic_sub(amt, prot->memory_allocated);
+	sk_memory_allocated_sub(prot, amt);
 	return 0;
 }
 EXPORT_SYMBOL(__sk_mem_schedule);
@@ -1667,12 +1804,12 @@ void __sk_mem_reclaim(struct sock *sk)
 {
 	struct proto *prot = sk->sk_prot;
 
-	atomic_sub(sk->sk_forward_alloc >> SK_MEM_QUANTUM_SHIFT,
-		   prot->memory_allocated);
+	sk_memory_allocated_sub(prot,
+				sk->sk_forward_alloc >> SK_MEM_QUANTUM_SHIFT);
 	sk->sk_forward_alloc &= SK_MEM_QUANTUM - 1;
 
 	if (prot->memory_pressure && *prot->memory_pressure &&
-	    (atomic_read(prot->memory_allocated) < prot->sysctl_mem[0]))
+	    proto_memory_cmp(prot, prot->sysctl_mem[0]) < 0)
 		*prot->memory_pressure = 0;
 }
 EXPORT_SYMBOL(__sk_mem_reclaim);
@@ -1874,6 +2011,7 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 	skb_queue_head_init(&sk->sk_receive_queue);
 	skb_queue_head_init(&sk->sk_write_queue);
 	skb_queue_head_init(&sk->sk_error_queue);
+	atomic_set(&sk->sk_zckey, 0);
 #ifdef CONFIG_NET_DMA
 	skb_queue_head_init(&sk->sk_async_wait_queue);
 #endif
@@ -1923,6 +2061,14 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 
 	sk->sk_stamp = ktime_set(-1L, 0);
 
+	sk->sk_max_pacing_rate = ~0U;
+	sk->sk_pacing_rate = ~0U;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	sk->sk_napi_id		=	0;
+	sk->sk_ll_usec		=	sysctl_net_busy_read;
+#endif
+
 	/*
 	 * Before updating sk_refcnt, we must commit prior changes to memory
 	 * (Documentation/RCU/rculist_nulls.txt for details)
@@ -1959,6 +2105,10 @@ void release_sock(struct sock *sk)
 	spin_lock_bh(&sk->sk_lock.slock);
 	if (sk->sk_backlog.tail)
 		__release_sock(sk);
+
+	if (sk->sk_prot->release_cb)
+		sk->sk_prot->release_cb(sk);
+
 	sk->sk_lock.owned = 0;
 	if (waitqueue_active(&sk->sk_lock.wq))
 		wake_up(&sk->sk_lock.wq);
@@ -2348,14 +2498,27 @@ static char proto_method_implemented(const void *method)
 	return method == NULL ? 'n' : 'y';
 }
 
+static long sock_prot_memory_allocated(struct proto *proto)
+{
+	long allocated;
+
+	if (proto->memory_allocated == NULL)
+		return -1;
+
+	local_bh_disable();
+	allocated = percpu_counter_sum_positive(proto->memory_allocated);
+	local_bh_enable();
+	return allocated;
+}
+
 static void proto_seq_printf(struct seq_file *seq, struct proto *proto)
 {
-	seq_printf(seq, "%-9s %4u %6d  %6d   %-3s %6u   %-3s  %-10s "
+	seq_printf(seq, "%-9s %4u %6d  %6ld   %-3s %6u   %-3s  %-10s "
 			"%2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c %2c\n",
 		   proto->name,
 		   proto->obj_size,
 		   sock_prot_inuse_get(seq_file_net(seq), proto),
-		   proto->memory_allocated != NULL ? atomic_read(proto->memory_allocated) : -1,
+		   sock_prot_memory_allocated(proto),
 		   proto->memory_pressure != NULL ? *proto->memory_pressure ? "yes" : "no" : "NI",
 		   proto->max_header,
 		   proto->slab == NULL ? "no" : "yes",
@@ -155,7 +155,7 @@ static const struct proto_ops dn_proto_ops;
 static DEFINE_RWLOCK(dn_hash_lock);
 static struct hlist_head dn_sk_hash[DN_SK_HASH_SIZE];
 static struct hlist_head dn_wild_sk;
-static atomic_t decnet_memory_allocated;
+static struct percpu_counter decnet_memory_allocated;
 
 static int __dn_setsockopt(struct socket *sock, int level, int optname, char __user *optval, unsigned int optlen, int flags);
 static int __dn_getsockopt(struct socket *sock, int level, int optname, char __user *optval, int __user *optlen, int flags);
@@ -2369,10 +2369,16 @@ static int __init decnet_init(void)
 
 	printk(banner);
 
-	rc = proto_register(&dn_proto, 1);
+	rc = percpu_counter_init(&decnet_memory_allocated, 0);
 	if (rc != 0)
 		goto out;
 
+	rc = proto_register(&dn_proto, 1);
+	if (rc != 0) {
+		percpu_counter_destroy(&decnet_memory_allocated);
+		goto out;
+	}
+
 	dn_neigh_init();
 	dn_dev_init();
 	dn_route_init();
@@ -2414,6 +2420,7 @@ static void __exit decnet_exit(void)
 	proc_net_remove(&init_net, "decnet");
 
 	proto_unregister(&dn_proto);
+	percpu_counter_destroy(&decnet_memory_allocated);
 
 	rcu_barrier_bh(); /* Wait for completion of call_rcu_bh()'s */
 }
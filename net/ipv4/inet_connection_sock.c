@@ -56,6 +56,8 @@ int inet_csk_bind_conflict(const struct sock *sk,
 	struct sock *sk2;
 	struct hlist_node *node;
 	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	int uid = sock_i_uid((struct sock *)sk);
 
 	/*
 	 * Unlike other sk lookup places we do not check
@@ -70,8 +72,11 @@ int inet_csk_bind_conflict(const struct sock *sk,
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if)) {
-			if (!reuse || !sk2->sk_reuse ||
-			    sk2->sk_state == TCP_LISTEN) {
+			if ((!reuse || !sk2->sk_reuse ||
+			    sk2->sk_state == TCP_LISTEN) &&
+			    (!reuseport || !sk2->sk_reuseport ||
+			    (sk2->sk_state != TCP_TIME_WAIT &&
+			     uid != sock_i_uid(sk2)))) {
 				const __be32 sk2_rcv_saddr = inet_rcv_saddr(sk2);
 				if (!sk2_rcv_saddr || !sk_rcv_saddr ||
 				    sk2_rcv_saddr == sk_rcv_saddr)
@@ -96,6 +101,7 @@ int inet_csk_get_port(struct sock *sk, unsigned short snum)
 	int ret, attempts = 5;
 	struct net *net = sock_net(sk);
 	int smallest_size = -1, smallest_rover;
+	int uid = sock_i_uid(sk);
 
 	local_bh_disable();
 	if (!snum) {
@@ -113,9 +119,12 @@ again:
 			spin_lock(&head->lock);
 			inet_bind_bucket_for_each(tb, node, &head->chain)
 				if (net_eq(ib_net(tb), net) && tb->port == rover) {
-					if (tb->fastreuse > 0 &&
-					    sk->sk_reuse &&
-					    sk->sk_state != TCP_LISTEN &&
+					if (((tb->fastreuse > 0 &&
+					      sk->sk_reuse &&
+					      sk->sk_state != TCP_LISTEN) ||
+					     (tb->fastreuseport > 0 &&
+					      sk->sk_reuseport &&
+					      tb->fastuid == uid)) &&
 					    (tb->num_owners < smallest_size || smallest_size == -1)) {
 						smallest_size = tb->num_owners;
 						smallest_rover = rover;
@@ -165,14 +174,18 @@ have_snum:
 	goto tb_not_found;
 tb_found:
 	if (!hlist_empty(&tb->owners)) {
-		if (tb->fastreuse > 0 &&
-		    sk->sk_reuse && sk->sk_state != TCP_LISTEN &&
+		if (((tb->fastreuse > 0 &&
+		      sk->sk_reuse && sk->sk_state != TCP_LISTEN) ||
+		     (tb->fastreuseport > 0 &&
+		      sk->sk_reuseport && tb->fastuid == uid)) &&
 		    smallest_size == -1) {
 			goto success;
 		} else {
 			ret = 1;
 			if (inet_csk(sk)->icsk_af_ops->bind_conflict(sk, tb)) {
-				if (sk->sk_reuse && sk->sk_state != TCP_LISTEN &&
+				if (((sk->sk_reuse && sk->sk_state != TCP_LISTEN) ||
+				     (tb->fastreuseport > 0 &&
+				      sk->sk_reuseport && tb->fastuid == uid)) &&
 				    smallest_size != -1 && --attempts >= 0) {
 					spin_unlock(&head->lock);
 					goto again;
@@ -191,9 +204,19 @@ tb_not_found:
 			tb->fastreuse = 1;
 		else
 			tb->fastreuse = 0;
-	} else if (tb->fastreuse &&
-		   (!sk->sk_reuse || sk->sk_state == TCP_LISTEN))
-		tb->fastreuse = 0;
+		if (sk->sk_reuseport) {
+			tb->fastreuseport = 1;
+			tb->fastuid = uid;
+		} else
+			tb->fastreuseport = 0;
+	} else {
+		if (tb->fastreuse &&
+		    (!sk->sk_reuse || sk->sk_state == TCP_LISTEN))
+			tb->fastreuse = 0;
+		if (tb->fastreuseport &&
+		    (!sk->sk_reuseport || tb->fastuid != uid))
+			tb->fastreuseport = 0;
+	}
 success:
 	if (!inet_csk(sk)->icsk_bind_hash)
 		inet_bind_hash(sk, tb, snum);
@@ -400,19 +423,27 @@ static inline u32 inet_synq_hash(const __be32 raddr, const __be16 rport,
 #define AF_INET_FAMILY(fam) 1
 #endif
 
-struct request_sock *inet_csk_search_req(const struct sock *sk,
-					 struct request_sock ***prevp,
+/*
+ * Look up a pending request for a SYN_RECV connection.  Listening sockets
+ * are not locked here, so the request is returned with a reference held
+ * which the caller drops with reqsk_put().
+ */
+struct request_sock *inet_csk_search_req(struct sock *sk,
 					 const __be16 rport, const __be32 raddr,
 					 const __be32 laddr)
 {
-	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	struct request_sock *req, **prev;
-
-	for (prev = &lopt->syn_table[inet_synq_hash(raddr, rport, lopt->hash_rnd,
-						    lopt->nr_table_entries)];
-	     (req = *prev) != NULL;
-	     prev = &req->dl_next) {
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct request_sock *req = NULL;
+	struct listen_sock *lopt;
+
+	read_lock(&queue->syn_wait_lock);
+	lopt = queue->listen_opt;
+	if (lopt == NULL)
+		goto out;
+
+	for (req = lopt->syn_table[inet_synq_hash(raddr, rport, lopt->hash_rnd,
+						  lopt->nr_table_entries)];
+	     req != NULL; req = req->dl_next) {
 		const struct inet_request_sock *ireq = inet_rsk(req);
 
 		if (ireq->rmt_port == rport &&
@@ -420,11 +451,12 @@ struct request_sock *inet_csk_search_req(const struct sock *sk,
 		    ireq->loc_addr == laddr &&
 		    AF_INET_FAMILY(req->rsk_ops->family)) {
 			WARN_ON(req->sk);
-			*prevp = prev;
+			atomic_inc(&req->rsk_refcnt);
 			break;
 		}
 	}
-
+out:
+	read_unlock(&queue->syn_wait_lock);
 	return req;
 }
 
@@ -433,20 +465,147 @@ EXPORT_SYMBOL_GPL(inet_csk_search_req);
 void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
 				   unsigned long timeout)
 {
-	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	const u32 h = inet_synq_hash(inet_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
-				     lopt->hash_rnd, lopt->nr_table_entries);
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct listen_sock *lopt;
+	int prev_qlen = -1;
+
+	write_lock(&queue->syn_wait_lock);
+	lopt = queue->listen_opt;
+	if (lopt != NULL) {
+		const u32 h = inet_synq_hash(inet_rsk(req)->rmt_addr,
+					     inet_rsk(req)->rmt_port,
+					     lopt->hash_rnd,
+					     lopt->nr_table_entries);
+
+		reqsk_queue_hash_req(queue, h, req, timeout);
+		prev_qlen = reqsk_queue_added(queue);
+	}
+	write_unlock(&queue->syn_wait_lock);
+
+	inet_csk_reqsk_queue_added(sk, req, prev_qlen, timeout);
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add);
+
+/*
+ * Mark @req as being turned into a child socket, so that a retransmitted
+ * ACK processed on another CPU does not create a second one.  Fails if
+ * someone else got there first or the request is gone already.
+ */
+int inet_csk_reqsk_queue_claim(struct sock *sk, struct request_sock *req)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	int claimed = 0;
 
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
-	inet_csk_reqsk_queue_added(sk, timeout);
+	write_lock(&queue->syn_wait_lock);
+	if (queue->listen_opt != NULL && req->rsk_hashed && !req->rsk_claimed) {
+		req->rsk_claimed = 1;
+		claimed = 1;
+	}
+	write_unlock(&queue->syn_wait_lock);
+	return claimed;
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_claim);
+
+void inet_csk_reqsk_queue_unclaim(struct sock *sk, struct request_sock *req)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+
+	write_lock(&queue->syn_wait_lock);
+	req->rsk_claimed = 0;
+	write_unlock(&queue->syn_wait_lock);
 }
 
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_unclaim);
+
+/*
+ * Take @req off the SYN table.  Returns nonzero if it was still there, the
+ * table's reference is then the caller's.  The keepalive timer is left
+ * alone when the queue drains, it finds nothing to do and stops by itself.
+ */
+int inet_csk_reqsk_queue_unlink(struct sock *sk, struct request_sock *req)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	int unlinked = 0;
+
+	write_lock(&queue->syn_wait_lock);
+	if (queue->listen_opt != NULL && req->rsk_hashed) {
+		reqsk_queue_unlink(queue, req);
+		reqsk_queue_removed(queue, req);
+		unlinked = 1;
+	}
+	write_unlock(&queue->syn_wait_lock);
+	return unlinked;
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_unlink);
+
+/*
+ * Get rid of a child nobody will accept.  It must be locked and referenced
+ * by the caller, both are released here.
+ */
+static void inet_child_forget(struct sock *sk, struct sock *child)
+{
+	sk->sk_prot->disconnect(child, O_NONBLOCK);
+
+	sock_orphan(child);
+
+	percpu_counter_inc(sk->sk_prot->orphan_count);
+
+	inet_csk_destroy_sock(child);
+
+	bh_unlock_sock(child);
+	sock_put(child);
+}
+
+/*
+ * Queue an established @child for accept(), the request passes its
+ * SYN table reference to the accept queue.  Returns @child, or NULL
+ * if the listener was closed meanwhile: the child is locked and
+ * referenced by the caller, which loses both in that case.
+ */
+struct sock *inet_csk_reqsk_queue_add(struct sock *sk,
+				      struct request_sock *req,
+				      struct sock *child)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+
+	spin_lock(&queue->rskq_lock);
+	if (unlikely(sk->sk_state != TCP_LISTEN)) {
+		spin_unlock(&queue->rskq_lock);
+		inet_child_forget(sk, child);
+		__reqsk_put(req);
+		return NULL;
+	}
+	reqsk_queue_add(queue, req, sk, child);
+	spin_unlock(&queue->rskq_lock);
+	return child;
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_add);
+
+/*
+ * Move @req from the SYN table to the accept queue once @child was
+ * created for it.  Returns NULL, the child being disposed of as in
+ * inet_csk_reqsk_queue_add(), if the request was dropped in the meantime.
+ */
+struct sock *inet_csk_reqsk_queue_complete(struct sock *sk,
+					   struct request_sock *req,
+					   struct sock *child)
+{
+	if (inet_csk_reqsk_queue_unlink(sk, req))
+		return inet_csk_reqsk_queue_add(sk, req, child);
+
+	inet_child_forget(sk, child);
+	return NULL;
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_complete);
+
 /* Only thing we need from tcp.h */
 extern int sysctl_tcp_synack_retries;
 
-EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add);
-
 /* Decide when to expire the request and when to resend SYN-ACK */
 static inline void syn_ack_recalc(struct request_sock *req, const int thresh,
 				  const int max_retries,
@@ -483,7 +642,7 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	struct request_sock **reqp, *req;
 	int i, budget;
 
-	if (lopt == NULL || lopt->qlen == 0)
+	if (lopt == NULL || queue->qlen == 0)
 		return;
 
 	/* Normally all the openreqs are young and become mature
@@ -503,11 +662,11 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	 * embrions; and abort old ones without pity, if old
 	 * ones are about to clog our table.
 	 */
-	if (lopt->qlen>>(lopt->max_qlen_log-1)) {
-		int young = (lopt->qlen_young<<1);
+	if (queue->qlen>>(queue->max_qlen_log-1)) {
+		int young = (queue->qlen_young<<1);
 
 		while (thresh > 2) {
-			if (lopt->qlen < young)
+			if (queue->qlen < young)
 				break;
 			thresh--;
 			young <<= 1;
@@ -521,24 +680,32 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	i = lopt->clock_hand;
 
 	do {
+		struct request_sock *rtx[16];
+		int nr_rtx = 0, done, n;
+
+		/* Segments for the listener are processed without its lock */
+		write_lock(&queue->syn_wait_lock);
 		reqp=&lopt->syn_table[i];
 		while ((req = *reqp) != NULL) {
 			if (time_after_eq(now, req->expires)) {
 				int expire = 0, resend = 0;
 
+				if (nr_rtx == ARRAY_SIZE(rtx))
+					break;
 				syn_ack_recalc(req, thresh, max_retries,
 					       queue->rskq_defer_accept,
 					       &expire, &resend);
 				if (req->rsk_ops->syn_ack_timeout)
 					req->rsk_ops->syn_ack_timeout(parent, req);
-				if (!expire &&
-				    (!resend ||
-				     !req->rsk_ops->rtx_syn_ack(parent, req, NULL) ||
-				     inet_rsk(req)->acked)) {
+				if (!expire) {
 					unsigned long timeo;
 
+					if (resend) {
+						atomic_inc(&req->rsk_refcnt);
+						rtx[nr_rtx++] = req;
+					}
 					if (req->retrans++ == 0)
-						lopt->qlen_young--;
+						queue->qlen_young--;
 					timeo = min((timeout << req->retrans), max_rto);
 					req->expires = now + timeo;
 					reqp = &req->dl_next;
@@ -546,21 +713,38 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 				}
 
 				/* Drop this request */
-				inet_csk_reqsk_queue_unlink(parent, req, reqp);
+				*reqp = req->dl_next;
+				req->rsk_hashed = 0;
 				reqsk_queue_removed(queue, req);
-				reqsk_free(req);
+				reqsk_put(req);
 				continue;
 			}
 			reqp = &req->dl_next;
 		}
+		done = req == NULL;
+		write_unlock(&queue->syn_wait_lock);
 
-		i = (i + 1) & (lopt->nr_table_entries - 1);
+		/* The SYN-ACKs go out without syn_wait_lock, which incoming
+		 * segments need to find their request.  A request whose
+		 * SYN-ACK cannot be sent is dropped, unless it was acked.
+		 */
+		for (n = 0; n < nr_rtx; n++) {
+			req = rtx[n];
+			if (req->rsk_ops->rtx_syn_ack(parent, req, NULL) &&
+			    !inet_rsk(req)->acked)
+				inet_csk_reqsk_queue_drop(parent, req);
+			reqsk_put(req);
+		}
+
+		/* A full batch leaves the rest of the bucket for the next pass */
+		if (done)
+			i = (i + 1) & (lopt->nr_table_entries - 1);
 
 	} while (--budget > 0);
 
 	lopt->clock_hand = i;
 
-	if (lopt->qlen)
+	if (queue->qlen)
 		inet_csk_reset_keepalive_timer(parent, interval);
 }
 
@@ -627,6 +811,21 @@ void inet_csk_destroy_sock(struct sock *sk)
 
 EXPORT_SYMBOL(inet_csk_destroy_sock);
 
+/* Lets a child that never got out of syn_recv_sock() go through
+ * tcp_done() -> inet_csk_destroy_sock().
+ */
+void inet_csk_prepare_forced_close(struct sock *sk)
+{
+	/* sk_clone() locked the socket and set refcnt to 2 */
+	bh_unlock_sock(sk);
+	sock_put(sk);
+
+	sock_set_flag(sk, SOCK_DEAD);
+	percpu_counter_inc(sk->sk_prot->orphan_count);
+	inet_sk(sk)->inet_num = 0;
+}
+EXPORT_SYMBOL(inet_csk_prepare_forced_close);
+
 int inet_csk_listen_start(struct sock *sk, const int nr_table_entries)
 {
 	struct inet_sock *inet = inet_sk(sk);
@@ -697,20 +896,11 @@ void inet_csk_listen_stop(struct sock *sk)
 		WARN_ON(sock_owned_by_user(child));
 		sock_hold(child);
 
-		sk->sk_prot->disconnect(child, O_NONBLOCK);
-
-		sock_orphan(child);
-
-		percpu_counter_inc(sk->sk_prot->orphan_count);
-
-		inet_csk_destroy_sock(child);
-
-		bh_unlock_sock(child);
+		inet_child_forget(sk, child);
 		local_bh_enable();
-		sock_put(child);
 
 		sk_acceptq_removed(sk);
-		__reqsk_free(req);
+		__reqsk_put(req);
 	}
 	WARN_ON(sk->sk_ack_backlog);
 }
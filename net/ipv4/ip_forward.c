@@ -69,6 +69,12 @@ int ip_forward(struct sk_buff *skb)
 	if (skb->pkt_type != PACKET_HOST)
 		goto drop;
 
+	/* A socket attached by early demux means the packet was meant
+	 * for us; the route changed under the connection.
+	 */
+	if (unlikely(skb->sk))
+		goto drop;
+
 	skb_forward_csum(skb);
 
 	/*
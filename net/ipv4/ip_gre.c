@@ -650,6 +650,9 @@ static int ipgre_rcv(struct sk_buff *skb)
 		skb_dst_drop(skb);
 		nf_reset(skb);
 
+		/* GRO merged the inner packets; the GRE header is gone now. */
+		skb_shinfo(skb)->gso_type &= ~SKB_GSO_TUNNEL;
+
 		skb_reset_network_header(skb);
 		ipgre_ecn_decapsulate(iph, skb);
 
@@ -1284,9 +1287,112 @@ static void ipgre_fb_tunnel_init(struct net_device *dev)
 }
 
 
+/*
+ * GRO and GSO for IPv4 in GRE.  Of the optional fields only the key is
+ * accepted: checksums and sequence numbers differ from packet to packet
+ * and would not survive merging.
+ */
+static inline int ipgre_gro_hlen(const __be16 *greh)
+{
+	if ((greh[0] & ~GRE_KEY) || greh[1] != htons(ETH_P_IP))
+		return 0;
+
+	return (greh[0] & GRE_KEY) ? 8 : 4;
+}
+
+static struct sk_buff **ipgre_gro_receive(struct sk_buff **head,
+					  struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	__be16 *greh;
+	unsigned int grehlen;
+	unsigned int hlen;
+	unsigned int off;
+	__wsum csum;
+	int flush = 1;
+
+	off = skb_gro_offset(skb);
+	hlen = off + 4;
+	greh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	grehlen = ipgre_gro_hlen(greh);
+	if (!grehlen)
+		goto out;
+
+	hlen = off + grehlen;
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	for (p = *head; p; p = p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		if (memcmp(skb_network_header(p) + off -
+			   skb_network_offset(skb), greh, grehlen))
+			NAPI_GRO_CB(p)->same_flow = 0;
+	}
+
+	skb_gro_pull(skb, grehlen);
+
+	/* Inner checksums are verified against skb->csum, which still
+	 * covers the GRE header.  The IP headers sum to zero.
+	 */
+	csum = skb->csum;
+	skb_postpull_rcsum(skb, greh, grehlen);
+
+	pp = inet_encap_gro_receive(head, skb);
+
+	skb->csum = csum;
+	flush = 0;
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+static int ipgre_gro_complete(struct sk_buff *skb)
+{
+	unsigned int hlen = ip_hdrlen(skb);
+	__be16 *greh = (__be16 *)(skb_network_header(skb) + hlen);
+
+	return inet_encap_gro_complete(skb, hlen + ipgre_gro_hlen(greh));
+}
+
+static struct sk_buff *ipgre_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	unsigned int grehlen;
+
+	if (unlikely(!pskb_may_pull(skb, 4)))
+		goto out;
+
+	grehlen = ipgre_gro_hlen((__be16 *)skb->data);
+	if (unlikely(!grehlen || !pskb_may_pull(skb, grehlen)))
+		goto out;
+
+	__skb_pull(skb, grehlen);
+	segs = inet_encap_gso_segment(skb, features);
+
+out:
+	return segs;
+}
+
 static const struct net_protocol ipgre_protocol = {
 	.handler	=	ipgre_rcv,
 	.err_handler	=	ipgre_err,
+	.gso_segment	=	ipgre_gso_segment,
+	.gro_receive	=	ipgre_gro_receive,
+	.gro_complete	=	ipgre_gro_complete,
 	.netns_ok	=	1,
 };
 
@@ -796,6 +796,7 @@ int ip_append_data(struct sock *sk,
 	int offset = 0;
 	unsigned int maxfraglen, fragheaderlen;
 	int csummode = CHECKSUM_NONE;
+	int paged = 0;
 	struct rtable *rt;
 
 	if (flags&MSG_PROBE)
@@ -826,6 +827,7 @@ int ip_append_data(struct sock *sk,
 		inet->cork.fragsize = mtu = inet->pmtudisc == IP_PMTUDISC_PROBE ?
 					    rt->u.dst.dev->mtu :
 					    dst_mtu(rt->u.dst.path);
+		inet->cork.gso_size = ipc->gso_size;
 		inet->cork.dst = &rt->u.dst;
 		inet->cork.length = 0;
 		sk->sk_sndmsg_page = NULL;
@@ -845,6 +847,16 @@ int ip_append_data(struct sock *sk,
 	}
 	hh_len = LL_RESERVED_SPACE(rt->u.dst.dev);
 
+	/* A UDP segmentation offload request is built as one large skb that
+	 * is cut into gso_size datagrams on output, so the path MTU does not
+	 * limit it here.  With scatter-gather the payload goes to page
+	 * fragments instead of a 64K linear buffer.
+	 */
+	if (inet->cork.gso_size) {
+		mtu = 0xFFFF;
+		paged = !!(rt->u.dst.dev->features & NETIF_F_SG);
+	}
+
 	fragheaderlen = sizeof(struct iphdr) + (opt ? opt->optlen : 0);
 	maxfraglen = ((mtu - fragheaderlen) & ~7) + fragheaderlen;
 
@@ -866,7 +878,7 @@ int ip_append_data(struct sock *sk,
 
 	inet->cork.length += length;
 	if (((length> mtu) || !skb_queue_empty(&sk->sk_write_queue)) &&
-	    (sk->sk_protocol == IPPROTO_UDP) &&
+	    (sk->sk_protocol == IPPROTO_UDP) && !inet->cork.gso_size &&
 	    (rt->u.dst.dev->features & NETIF_F_UFO)) {
 		err = ip_ufo_append_data(sk, getfrag, from, length, hh_len,
 					 fragheaderlen, transhdrlen, mtu,
@@ -897,9 +909,11 @@ int ip_append_data(struct sock *sk,
 			unsigned int fraglen;
 			unsigned int fraggap;
 			unsigned int alloclen;
+			unsigned int pagedlen;
 			struct sk_buff *skb_prev;
 alloc_new_skb:
 			skb_prev = skb;
+			pagedlen = 0;
 			if (skb_prev)
 				fraggap = skb_prev->len - maxfraglen;
 			else
@@ -917,8 +931,12 @@ alloc_new_skb:
 			if ((flags & MSG_MORE) &&
 			    !(rt->u.dst.dev->features&NETIF_F_SG))
 				alloclen = mtu;
-			else
+			else if (!paged)
 				alloclen = datalen + fragheaderlen;
+			else {
+				alloclen = fragheaderlen + transhdrlen;
+				pagedlen = datalen - transhdrlen;
+			}
 
 			/* The last fragment gets additional space at tail.
 			 * Note, with MSG_MORE we overallocate on fragments,
@@ -960,7 +978,7 @@ alloc_new_skb:
 			/*
 			 *	Find where to start putting bytes.
 			 */
-			data = skb_put(skb, fraglen);
+			data = skb_put(skb, fraglen - pagedlen);
 			skb_set_network_header(skb, exthdrlen);
 			skb->transport_header = (skb->network_header +
 						 fragheaderlen);
@@ -976,7 +994,7 @@ alloc_new_skb:
 				pskb_trim_unique(skb_prev, maxfraglen);
 			}
 
-			copy = datalen - transhdrlen - fraggap;
+			copy = datalen - transhdrlen - fraggap - pagedlen;
 			if (copy > 0 && getfrag(from, data + transhdrlen, offset, copy, fraggap, skb) < 0) {
 				err = -EFAULT;
 				kfree_skb(skb);
@@ -984,7 +1002,7 @@ alloc_new_skb:
 			}
 
 			offset += copy;
-			length -= datalen - fraggap;
+			length -= copy + transhdrlen;
 			transhdrlen = 0;
 			exthdrlen = 0;
 			csummode = CHECKSUM_NONE;
@@ -1098,7 +1116,7 @@ ssize_t	ip_append_page(struct sock *sk, struct page *page,
 		return -EOPNOTSUPP;
 
 	hh_len = LL_RESERVED_SPACE(rt->u.dst.dev);
-	mtu = inet->cork.fragsize;
+	mtu = inet->cork.gso_size ? 0xFFFF : inet->cork.fragsize;
 
 	fragheaderlen = sizeof(struct iphdr) + (opt ? opt->optlen : 0);
 	maxfraglen = ((mtu - fragheaderlen) & ~7) + fragheaderlen;
@@ -1112,7 +1130,7 @@ ssize_t	ip_append_page(struct sock *sk, struct page *page,
 		return -EINVAL;
 
 	inet->cork.length += size;
-	if ((sk->sk_protocol == IPPROTO_UDP) &&
+	if ((sk->sk_protocol == IPPROTO_UDP) && !inet->cork.gso_size &&
 	    (rt->u.dst.dev->features & NETIF_F_UFO)) {
 		skb_shinfo(skb)->gso_size = mtu - fragheaderlen;
 		skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
@@ -1263,9 +1281,10 @@ int ip_push_pending_frames(struct sock *sk)
 
 	/* DF bit is set when we want to see DF on outgoing frames.
 	 * If local_df is set too, we still allow to fragment this frame
-	 * locally. */
+	 * locally.  The datagrams cut from a UDP GSO skb each fit the
+	 * path MTU. */
 	if (inet->pmtudisc >= IP_PMTUDISC_DO ||
-	    (skb->len <= dst_mtu(&rt->u.dst) &&
+	    ((skb->len <= dst_mtu(&rt->u.dst) || inet->cork.gso_size) &&
 	     ip_dont_fragment(sk, &rt->u.dst)))
 		df = htons(IP_DF);
 
@@ -1286,7 +1305,11 @@ int ip_push_pending_frames(struct sock *sk)
 	}
 	iph->tos = inet->tos;
 	iph->frag_off = df;
-	ip_select_ident(iph, &rt->u.dst, sk);
+	if (inet->cork.gso_size)
+		ip_select_ident_more(iph, &rt->u.dst, sk,
+				     (skb_shinfo(skb)->gso_segs ?: 1) - 1);
+	else
+		ip_select_ident(iph, &rt->u.dst, sk);
 	iph->ttl = ttl;
 	iph->protocol = sk->sk_protocol;
 	iph->saddr = rt->rt_src;
@@ -1375,6 +1398,7 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, struct ip_reply_arg *ar
 	daddr = ipc.addr = rt->rt_src;
 	ipc.opt = NULL;
 	ipc.shtx.flags = 0;
+	ipc.gso_size = 0;
 
 	if (replyopts.opt.optlen) {
 		ipc.opt = &replyopts.opt;
@@ -0,0 +1,719 @@
+/*
+ * TCP BBR: Bottleneck Bandwidth and RTT congestion control
+ *
+ * BBR computes the sending rate from the delivery rate (throughput)
+ * estimated from ACKs.  In a nutshell, on each ACK it updates its model
+ * of the network path:
+ *
+ *    bottleneck_bandwidth = windowed_max(delivered / elapsed, 10 round trips)
+ *    min_rtt = windowed_min(rtt, 10 seconds)
+ *
+ * and then sends at:
+ *
+ *    pacing_rate = pacing_gain * bottleneck_bandwidth
+ *    cwnd = max(cwnd_gain * bottleneck_bandwidth * min_rtt, 4)
+ *
+ * The model does not react directly to packet loss or delay.  A flow
+ * starts in STARTUP, ramping up its rate exponentially like slow start.
+ * Once the bandwidth estimate stops growing the pipe is considered full,
+ * and DRAIN empties the queue STARTUP built.  The flow then spends most
+ * of its time in PROBE_BW, cycling the pacing gain around 1.0 to probe
+ * for more bandwidth and give up bandwidth other flows need.  When the
+ * min_rtt estimate has not been refreshed for 10 seconds, PROBE_RTT
+ * briefly cuts the flight size to 4 packets so that the propagation delay
+ * can be measured again with the bottleneck queue drained.
+ *
+ * The delivery rate samples come from tcp_rate.c.  Pacing is left to the
+ * fq packet scheduler, BBR should only be used on interfaces running it.
+ */
+
+#include <linux/module.h>
+#include <linux/random.h>
+#include <asm/div64.h>
+#include <net/tcp.h>
+
+/* Scale factor for rate in pkt/uSec unit to avoid truncation in bandwidth
+ * estimation.  The rate unit ~= (1500 bytes / 1 usec / 2^24) ~= 715 bps.
+ */
+#define BW_SCALE	24
+#define BW_UNIT		(1 << BW_SCALE)
+
+#define BBR_SCALE	8	/* scaling factor for fractions (e.g. gains) */
+#define BBR_UNIT	(1 << BBR_SCALE)
+
+/* BBR has the following modes for deciding how fast to send: */
+enum bbr_mode {
+	BBR_STARTUP,	/* ramp up sending rate rapidly to fill pipe */
+	BBR_DRAIN,	/* drain any queue created during startup */
+	BBR_PROBE_BW,	/* discover, share bw: pace around estimated bw */
+	BBR_PROBE_RTT,	/* cut cwnd to min to probe min_rtt */
+};
+
+/* Windowed max filter, remembering the best, 2nd best and 3rd best
+ * samples so that the max can be aged out in constant time.  See
+ * Kathleen Nichols' algorithm for tracking the minimum (or maximum)
+ * value of a data stream over some fixed time interval.
+ */
+struct bbr_max_sample {
+	u32	t;	/* time the measurement was taken */
+	u32	v;	/* value measured */
+};
+
+struct bbr_max_filter {
+	struct bbr_max_sample s[3];
+};
+
+/* BBR congestion control block */
+struct bbr {
+	u32	min_rtt_us;		/* min RTT in bbr_min_rtt_win_sec */
+	u32	min_rtt_stamp;		/* timestamp of min_rtt_us */
+	u32	probe_rtt_done_stamp;	/* end time for BBR_PROBE_RTT mode */
+	struct bbr_max_filter bw;	/* max recent rate in pkts/uS << 24 */
+	u32	rtt_cnt;		/* count of packet-timed rounds */
+	u32	next_rtt_delivered;	/* tp->delivered at end of round */
+	u32	cycle_mstamp;		/* start of this gain cycle phase, us */
+	u32	mode:3,			/* current bbr_mode in state machine */
+		prev_ca_state:3,	/* CA state on previous ACK */
+		packet_conservation:1,	/* use packet conservation? */
+		restore_cwnd:1,		/* decided to revert cwnd to old value */
+		round_start:1,		/* start of packet-timed round? */
+		idle_restart:1,		/* restarting after idle? */
+		probe_rtt_round_done:1,	/* a BBR_PROBE_RTT round at 4 pkts? */
+		unused:21;
+	u32	pacing_gain:10,		/* current gain for pacing rate */
+		cwnd_gain:10,		/* current gain for cwnd */
+		full_bw_cnt:3,		/* rounds without large bw gains */
+		cycle_idx:3,		/* current index in pacing_gain cycle */
+		unused_b:6;
+	u32	prior_cwnd;		/* cwnd before loss recovery */
+	u32	full_bw;		/* recent bw, to estimate if pipe full */
+};
+
+#define CYCLE_LEN	8	/* number of phases in a pacing gain cycle */
+
+/* Window length of bw filter (in rounds): */
+static const int bbr_bw_rtts = CYCLE_LEN + 2;
+/* Window length of min_rtt filter (in sec): */
+static const u32 bbr_min_rtt_win_sec = 10;
+/* Minimum time (in ms) spent at bbr_cwnd_min_target in BBR_PROBE_RTT: */
+static const u32 bbr_probe_rtt_mode_ms = 200;
+
+/* The high_gain of 2/ln(2) is the smallest pacing gain that still doubles
+ * the sending rate each round, sending as many packets per RTT as an
+ * unpaced slow-starting Reno or CUBIC flow would.
+ */
+static const int bbr_high_gain  = BBR_UNIT * 2885 / 1000 + 1;
+/* The pacing gain of 1/high_gain in BBR_DRAIN is calculated to typically
+ * drain the queue created in BBR_STARTUP in a single round:
+ */
+static const int bbr_drain_gain = BBR_UNIT * 1000 / 2885;
+/* The gain for deriving steady-state cwnd tolerates delayed/stretched ACKs: */
+static const int bbr_cwnd_gain  = BBR_UNIT * 2;
+/* The pacing_gain values for the PROBE_BW gain cycle, to discover/share bw: */
+static const int bbr_pacing_gain[] = {
+	BBR_UNIT * 5 / 4,	/* probe for more available bw */
+	BBR_UNIT * 3 / 4,	/* drain queue and/or yield bw to other flows */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT,	/* cruise at 1.0*bw to utilize pipe, */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT	/* without creating excess queue... */
+};
+/* Randomize the starting gain cycling phase over N phases: */
+static const u32 bbr_cycle_rand = 7;
+
+/* Try to keep at least this many packets in flight.  A sliding window
+ * protocol ACKing every other packet needs at least 4 to run smoothly.
+ */
+static const u32 bbr_cwnd_min_target = 4;
+
+/* If bw has increased significantly (1.25x), there may be more bw available: */
+static const u32 bbr_full_bw_thresh = BBR_UNIT * 5 / 4;
+/* But after 3 rounds w/o significant bw growth, estimate pipe is full: */
+static const u32 bbr_full_bw_cnt = 3;
+
+static u32 bbr_filter_get(const struct bbr_max_filter *m)
+{
+	return m->s[0].v;
+}
+
+static void bbr_filter_reset(struct bbr_max_filter *m, u32 t, u32 meas)
+{
+	struct bbr_max_sample val = { .t = t, .v = meas };
+
+	m->s[2] = m->s[1] = m->s[0] = val;
+}
+
+/* Fold a new measurement taken at time t into the window of length win. */
+static void bbr_filter_update(struct bbr_max_filter *m, u32 win, u32 t,
+			      u32 meas)
+{
+	struct bbr_max_sample val = { .t = t, .v = meas };
+	u32 dt;
+
+	if (unlikely(val.v >= m->s[0].v) ||	/* found new max? */
+	    unlikely(val.t - m->s[2].t > win)) {	/* nothing left in window? */
+		bbr_filter_reset(m, t, meas);	/* forget earlier samples */
+		return;
+	}
+
+	if (unlikely(val.v >= m->s[1].v))
+		m->s[2] = m->s[1] = val;
+	else if (unlikely(val.v >= m->s[2].v))
+		m->s[2] = val;
+
+	/* As time advances, update the 1st, 2nd and 3rd choices. */
+	dt = val.t - m->s[0].t;
+	if (unlikely(dt > win)) {
+		/* Passed the entire window without a new max, so promote
+		 * the 2nd and 3rd choices.  The 2nd choice may be outside
+		 * the window too, the 3rd was checked on entry.
+		 */
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = val;
+		if (unlikely(val.t - m->s[0].t > win)) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = val;
+		}
+	} else if (unlikely(m->s[1].t == m->s[0].t) && dt > win / 4) {
+		/* A quarter of the window passed without a new max, take a
+		 * 2nd choice from the 2nd quarter of the window.
+		 */
+		m->s[2] = m->s[1] = val;
+	} else if (unlikely(m->s[2].t == m->s[1].t) && dt > win / 2) {
+		/* Half the window passed without a new max, take a 3rd
+		 * choice from the last half of the window.
+		 */
+		m->s[2] = val;
+	}
+}
+
+/* Do we estimate that STARTUP filled the pipe? */
+static bool bbr_full_bw_reached(const struct sock *sk)
+{
+	const struct bbr *bbr = inet_csk_ca(sk);
+
+	return bbr->full_bw_cnt >= bbr_full_bw_cnt;
+}
+
+/* Return the windowed max recent bandwidth sample, in pkts/uS << BW_SCALE. */
+static u32 bbr_bw(const struct sock *sk)
+{
+	const struct bbr *bbr = inet_csk_ca(sk);
+
+	return bbr_filter_get(&bbr->bw);
+}
+
+/* Time the connection last reached tp->delivered, truncated to u32 us. */
+static u32 bbr_delivered_us(const struct tcp_sock *tp)
+{
+	return (u32)ktime_to_us(tp->delivered_mstamp);
+}
+
+/* Return rate in bytes per second, optionally with a gain.  The order
+ * here avoids overflow of u64 for rates up to 2.9Tbit/sec and a gain
+ * of 2.89x.
+ */
+static u64 bbr_rate_bytes_per_sec(struct sock *sk, u64 rate, int gain)
+{
+	rate *= tcp_mss_to_mtu(sk, tcp_sk(sk)->mss_cache);
+	rate *= gain;
+	rate >>= BBR_SCALE;
+	rate *= USEC_PER_SEC;
+	return rate >> BW_SCALE;
+}
+
+/* Pace using the current bw estimate and a gain factor.  Leaving out the
+ * link layer headers from the packet size keeps the average pacing rate
+ * slightly (~1%) below the estimated bw, which helps drain queues.
+ */
+static void bbr_set_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 rate = bw;
+
+	rate = bbr_rate_bytes_per_sec(sk, rate, gain);
+	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
+	if (bbr->mode != BBR_STARTUP || rate > sk->sk_pacing_rate)
+		sk->sk_pacing_rate = rate;
+}
+
+/* Save "last known good" cwnd so we can restore it after losses. */
+static void bbr_save_cwnd(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->prev_ca_state < TCP_CA_Recovery && bbr->mode != BBR_PROBE_RTT)
+		bbr->prior_cwnd = tp->snd_cwnd;  /* this cwnd is good enough */
+	else  /* loss recovery or BBR_PROBE_RTT have temporarily cut cwnd */
+		bbr->prior_cwnd = max(bbr->prior_cwnd, tp->snd_cwnd);
+}
+
+/* Find target cwnd, the estimated bandwidth-delay product times gain.
+ * A small gain builds a smaller queue but is more exposed to noise in
+ * the RTT samples from delayed or compressed ACKs.
+ */
+static u32 bbr_target_cwnd(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 cwnd;
+	u64 w;
+
+	/* Without a valid RTT sample (e.g. everything ACKed so far was
+	 * retransmitted, and there are no timestamps) stay at the initial
+	 * window.
+	 */
+	if (unlikely(bbr->min_rtt_us == ~0U))
+		return tcp_init_cwnd(tcp_sk(sk), __sk_dst_get(sk));
+
+	w = (u64)bw * bbr->min_rtt_us;
+
+	/* Apply a gain to the given value, then remove the BW_SCALE shift. */
+	cwnd = (((w * gain) >> BBR_SCALE) + BW_UNIT - 1) >> BW_SCALE;
+
+	/* Reduce delayed ACKs by rounding up cwnd to the next even number. */
+	cwnd = (cwnd + 1) & ~1U;
+
+	return cwnd;
+}
+
+/* On the first round of recovery follow the packet conservation
+ * principle: send P packets per P packets acked.  After that slow-start
+ * and send at most 2*P packets per P packets acked.  After recovery
+ * finishes, or upon undo, restore the cwnd we had when recovery started
+ * (capped by the target cwnd based on estimated BDP).
+ */
+static bool bbr_set_cwnd_to_recover_or_restore(struct sock *sk,
+					       const struct rate_sample *rs,
+					       u32 acked, u32 *new_cwnd)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u8 prev_state = bbr->prev_ca_state, state = inet_csk(sk)->icsk_ca_state;
+	u32 cwnd = tp->snd_cwnd;
+
+	/* An ACK for P pkts should release at most 2*P packets.  First
+	 * deduct the number of lost packets here, then bbr_set_cwnd()
+	 * slow-starts up toward the target cwnd.
+	 */
+	if (rs->losses > 0)
+		cwnd = max_t(s32, cwnd - rs->losses, 1);
+
+	if (state == TCP_CA_Recovery && prev_state != TCP_CA_Recovery) {
+		/* Starting 1st round of Recovery, so do packet conservation. */
+		bbr->packet_conservation = 1;
+		bbr->next_rtt_delivered = tp->delivered;  /* start round now */
+		/* Cut unused cwnd from app behavior, TSQ, or TSO deferral: */
+		cwnd = tcp_packets_in_flight(tp) + acked;
+	} else if (prev_state >= TCP_CA_Recovery && state < TCP_CA_Recovery) {
+		/* Exiting loss recovery; restore cwnd saved before recovery. */
+		bbr->restore_cwnd = 1;
+		bbr->packet_conservation = 0;
+	}
+	bbr->prev_ca_state = state;
+
+	if (bbr->restore_cwnd) {
+		/* Restore cwnd after exiting loss recovery or PROBE_RTT. */
+		cwnd = max(cwnd, bbr->prior_cwnd);
+		bbr->restore_cwnd = 0;
+	}
+
+	if (bbr->packet_conservation) {
+		*new_cwnd = max(cwnd, tcp_packets_in_flight(tp) + acked);
+		return true;	/* yes, using packet conservation */
+	}
+	*new_cwnd = cwnd;
+	return false;
+}
+
+/* Slow-start up toward target cwnd (if bw estimate is growing, or packet
+ * loss has drawn us down below target), or snap down to target if we're
+ * above it.
+ */
+static void bbr_set_cwnd(struct sock *sk, const struct rate_sample *rs,
+			 u32 acked, u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 cwnd = 0, target_cwnd = 0;
+
+	if (!acked)
+		return;
+
+	if (bbr_set_cwnd_to_recover_or_restore(sk, rs, acked, &cwnd))
+		goto done;
+
+	/* If we're below target cwnd, slow start cwnd toward target cwnd. */
+	target_cwnd = bbr_target_cwnd(sk, bw, gain);
+	if (bbr_full_bw_reached(sk))  /* only cut cwnd if we filled the pipe */
+		cwnd = min(cwnd + acked, target_cwnd);
+	else if (cwnd < target_cwnd ||
+		 tp->delivered < tcp_init_cwnd(tp, __sk_dst_get(sk)))
+		cwnd = cwnd + acked;
+	cwnd = max(cwnd, bbr_cwnd_min_target);
+
+done:
+	tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);	/* apply global cap */
+	tp->snd_cwnd_stamp = tcp_time_stamp;
+	if (bbr->mode == BBR_PROBE_RTT)  /* drain queue, refresh min_rtt */
+		tp->snd_cwnd = min(tp->snd_cwnd, bbr_cwnd_min_target);
+}
+
+/* End cycle phase if it's time and/or we hit the phase's in-flight target. */
+static bool bbr_is_next_cycle_phase(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	bool is_full_length = bbr_delivered_us(tp) - bbr->cycle_mstamp >
+			      bbr->min_rtt_us;
+	u32 inflight, bw;
+
+	/* The pacing_gain of 1.0 paces at the estimated bw to try to fully
+	 * use the pipe without increasing the queue.
+	 */
+	if (bbr->pacing_gain == BBR_UNIT)
+		return is_full_length;		/* just use wall clock time */
+
+	inflight = rs->prior_in_flight;  /* what was in-flight before ACK? */
+	bw = bbr_bw(sk);
+
+	/* A pacing_gain > 1.0 probes for bw by trying to raise inflight to
+	 * at least pacing_gain*BDP; this may take more than min_rtt if
+	 * min_rtt is small (e.g. on a LAN).  We do not persist if packets
+	 * are lost, since a path with small buffers may not hold that much.
+	 */
+	if (bbr->pacing_gain > BBR_UNIT)
+		return is_full_length &&
+			(rs->losses ||  /* perhaps pacing_gain*BDP won't fit */
+			 inflight >= bbr_target_cwnd(sk, bw, bbr->pacing_gain));
+
+	/* A pacing_gain < 1.0 tries to drain extra queue we added if bw
+	 * probing didn't find more bw.  If inflight falls to match BDP then
+	 * we estimate queue is drained; persisting would underutilize the
+	 * pipe.
+	 */
+	return is_full_length ||
+		inflight <= bbr_target_cwnd(sk, bw, BBR_UNIT);
+}
+
+static void bbr_advance_cycle_phase(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->cycle_idx = (bbr->cycle_idx + 1) & (CYCLE_LEN - 1);
+	bbr->cycle_mstamp = bbr_delivered_us(tp);
+	bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_idx];
+}
+
+/* Gain cycling: cycle pacing gain to converge to fair share of available bw. */
+static void bbr_update_cycle_phase(struct sock *sk,
+				   const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_PROBE_BW && bbr_is_next_cycle_phase(sk, rs))
+		bbr_advance_cycle_phase(sk);
+}
+
+static void bbr_reset_startup_mode(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->mode = BBR_STARTUP;
+	bbr->pacing_gain = bbr_high_gain;
+	bbr->cwnd_gain	 = bbr_high_gain;
+}
+
+static void bbr_reset_probe_bw_mode(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->mode = BBR_PROBE_BW;
+	bbr->pacing_gain = BBR_UNIT;
+	bbr->cwnd_gain = bbr_cwnd_gain;
+	bbr->cycle_idx = CYCLE_LEN - 1 - random32() % bbr_cycle_rand;
+	bbr_advance_cycle_phase(sk);	/* flip to next phase of gain cycle */
+}
+
+static void bbr_reset_mode(struct sock *sk)
+{
+	if (!bbr_full_bw_reached(sk))
+		bbr_reset_startup_mode(sk);
+	else
+		bbr_reset_probe_bw_mode(sk);
+}
+
+/* Estimate the bandwidth based on how fast packets are delivered */
+static void bbr_update_bw(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bw;
+
+	bbr->round_start = 0;
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return; /* Not a valid observation */
+
+	/* An interval shorter than min_rtt means a spuriously retransmitted
+	 * skb was (s)acked, and would overestimate the rate.
+	 */
+	if (rs->interval_us < bbr->min_rtt_us)
+		return;
+
+	/* See if we've reached the next RTT */
+	if (!before(rs->prior_delivered, bbr->next_rtt_delivered)) {
+		bbr->next_rtt_delivered = tp->delivered;
+		bbr->rtt_cnt++;
+		bbr->round_start = 1;
+		bbr->packet_conservation = 0;
+	}
+
+	/* Divide delivered by the interval to find a (lower bound)
+	 * bottleneck bandwidth sample.  Delivered is in packets and
+	 * interval_us in uS, and the ratio will be <<1 for most
+	 * connections, so delivered is scaled first.
+	 */
+	bw = (u64)rs->delivered * BW_UNIT;
+	do_div(bw, rs->interval_us);
+
+	/* An application-limited sample likely reflects the application
+	 * rather than the network, and would needlessly drag the estimate
+	 * down.  Only use it if it describes the path at least as well as
+	 * the current model.
+	 */
+	if (!rs->is_app_limited || bw >= bbr_bw(sk))
+		bbr_filter_update(&bbr->bw, bbr_bw_rtts, bbr->rtt_cnt, bw);
+}
+
+/* Estimate when the pipe is full, using the change in delivery rate: BBR
+ * estimates that STARTUP filled the pipe if the estimated bw hasn't
+ * changed by at least bbr_full_bw_thresh (25%) after bbr_full_bw_cnt (3)
+ * non-app-limited rounds.  Why 3 rounds: 1: rwin autotuning grows the
+ * rwin, 2: we fill the higher rwin, 3: we get higher delivery rate
+ * samples.  Or transient cross-traffic or radio noise can go away.
+ */
+static void bbr_check_full_bw_reached(struct sock *sk,
+				      const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bw_thresh;
+
+	if (bbr_full_bw_reached(sk) || !bbr->round_start || rs->is_app_limited)
+		return;
+
+	bw_thresh = (u64)bbr->full_bw * bbr_full_bw_thresh >> BBR_SCALE;
+	if (bbr_bw(sk) >= bw_thresh) {
+		bbr->full_bw = bbr_bw(sk);
+		bbr->full_bw_cnt = 0;
+		return;
+	}
+	++bbr->full_bw_cnt;
+}
+
+/* If pipe is probably full, drain the queue and then enter steady-state. */
+static void bbr_check_drain(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP && bbr_full_bw_reached(sk)) {
+		bbr->mode = BBR_DRAIN;	/* drain queue we created */
+		bbr->pacing_gain = bbr_drain_gain;	/* pace slow to drain */
+		bbr->cwnd_gain = bbr_high_gain;	/* maintain cwnd */
+	}	/* fall through to check if in-flight is already small: */
+	if (bbr->mode == BBR_DRAIN &&
+	    tcp_packets_in_flight(tcp_sk(sk)) <=
+	    bbr_target_cwnd(sk, bbr_bw(sk), BBR_UNIT))
+		bbr_reset_probe_bw_mode(sk);  /* we estimate queue is drained */
+}
+
+/* PROBE_RTT makes BBR flows periodically and cooperatively drain the
+ * bottleneck queue, so that they measure the true min_rtt (the unloaded
+ * propagation delay), keep queues small and share the link fairly.
+ *
+ * When the 10 second min_rtt estimate expires we cap cwnd at
+ * bbr_cwnd_min_target packets.  After at least bbr_probe_rtt_mode_ms and
+ * one packet-timed round at that flight size we go back to the previous
+ * mode, which bounds the throughput cost to roughly 2% (200ms/10s).
+ * Flows with natural silences (request/response, video chunks) refresh
+ * min_rtt on their own and never need to enter this mode.
+ */
+static void bbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	bool filter_expired;
+
+	/* Track min RTT seen in the min_rtt_win_sec filter window: */
+	filter_expired = after(tcp_time_stamp,
+			       bbr->min_rtt_stamp + bbr_min_rtt_win_sec * HZ);
+	if (rs->rtt_us >= 0 &&
+	    (rs->rtt_us <= bbr->min_rtt_us || filter_expired)) {
+		bbr->min_rtt_us = rs->rtt_us;
+		bbr->min_rtt_stamp = tcp_time_stamp;
+	}
+
+	if (bbr_probe_rtt_mode_ms > 0 && filter_expired &&
+	    !bbr->idle_restart && bbr->mode != BBR_PROBE_RTT) {
+		bbr->mode = BBR_PROBE_RTT;  /* dip, drain queue */
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain = BBR_UNIT;
+		bbr_save_cwnd(sk);  /* note cwnd so we can restore it */
+		bbr->probe_rtt_done_stamp = 0;
+	}
+
+	if (bbr->mode == BBR_PROBE_RTT) {
+		/* Ignore low rate samples during this mode. */
+		tp->app_limited =
+			(tp->delivered + tcp_packets_in_flight(tp)) ? : 1;
+		/* Maintain min packets in flight for max(200 ms, 1 round). */
+		if (!bbr->probe_rtt_done_stamp &&
+		    tcp_packets_in_flight(tp) <= bbr_cwnd_min_target) {
+			bbr->probe_rtt_done_stamp = tcp_time_stamp +
+				msecs_to_jiffies(bbr_probe_rtt_mode_ms);
+			bbr->probe_rtt_round_done = 0;
+			bbr->next_rtt_delivered = tp->delivered;
+		} else if (bbr->probe_rtt_done_stamp) {
+			if (bbr->round_start)
+				bbr->probe_rtt_round_done = 1;
+			if (bbr->probe_rtt_round_done &&
+			    after(tcp_time_stamp, bbr->probe_rtt_done_stamp)) {
+				bbr->min_rtt_stamp = tcp_time_stamp;
+				bbr->restore_cwnd = 1;  /* snap to prior_cwnd */
+				bbr_reset_mode(sk);
+			}
+		}
+	}
+	bbr->idle_restart = 0;
+}
+
+static void bbr_update_model(struct sock *sk, const struct rate_sample *rs)
+{
+	bbr_update_bw(sk, rs);
+	bbr_update_cycle_phase(sk, rs);
+	bbr_check_full_bw_reached(sk, rs);
+	bbr_check_drain(sk, rs);
+	bbr_update_min_rtt(sk, rs);
+}
+
+static void bbr_main(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bw;
+
+	bbr_update_model(sk, rs);
+
+	bw = bbr_bw(sk);
+	bbr_set_pacing_rate(sk, bw, bbr->pacing_gain);
+	bbr_set_cwnd(sk, rs, rs->acked_sacked, bw, bbr->cwnd_gain);
+}
+
+static void bbr_init(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 rtt_us;
+	u64 bw;
+
+	bbr->prior_cwnd = 0;
+	bbr->rtt_cnt = 0;
+	bbr->next_rtt_delivered = 0;
+	bbr->prev_ca_state = TCP_CA_Open;
+	bbr->packet_conservation = 0;
+
+	bbr->probe_rtt_done_stamp = 0;
+	bbr->probe_rtt_round_done = 0;
+	bbr->min_rtt_us = ~0U;
+	bbr->min_rtt_stamp = tcp_time_stamp;
+
+	bbr_filter_reset(&bbr->bw, bbr->rtt_cnt, 0);  /* init max bw to 0 */
+
+	/* Initialize pacing rate to: high_gain * init_cwnd / RTT. */
+	rtt_us = jiffies_to_usecs(tp->srtt >> 3) ? : USEC_PER_MSEC;
+	bw = (u64)tp->snd_cwnd * BW_UNIT;
+	do_div(bw, rtt_us);
+	sk->sk_pacing_rate = 0;		/* force an update of sk_pacing_rate */
+	bbr_set_pacing_rate(sk, bw, bbr_high_gain);
+
+	bbr->restore_cwnd = 0;
+	bbr->round_start = 0;
+	bbr->idle_restart = 0;
+	bbr->full_bw = 0;
+	bbr->full_bw_cnt = 0;
+	bbr->cycle_mstamp = 0;
+	bbr->cycle_idx = 0;
+	bbr_reset_startup_mode(sk);
+}
+
+/* BBR does not cut cwnd on loss the way Reno does, so there is nothing
+ * to undo.
+ */
+static u32 bbr_undo_cwnd(struct sock *sk)
+{
+	return tcp_sk(sk)->snd_cwnd;
+}
+
+/* Entering loss recovery, so save cwnd for when we exit or undo recovery. */
+static u32 bbr_ssthresh(struct sock *sk)
+{
+	bbr_save_cwnd(sk);
+	return TCP_INFINITE_SSTHRESH;	 /* BBR does not use ssthresh */
+}
+
+static void bbr_set_state(struct sock *sk, u8 new_state)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (new_state == TCP_CA_Loss) {
+		bbr->prev_ca_state = TCP_CA_Loss;
+		bbr->full_bw = 0;
+		bbr->round_start = 1;	/* treat RTO like end of a round */
+	}
+}
+
+static void bbr_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (event == CA_EVENT_TX_START && tp->app_limited) {
+		bbr->idle_restart = 1;
+		/* Avoid pointless buffer overflows: pace at est. bw if we
+		 * don't need more speed (restarting from idle, app-limited).
+		 */
+		if (bbr->mode == BBR_PROBE_BW)
+			bbr_set_pacing_rate(sk, bbr_bw(sk), BBR_UNIT);
+	}
+}
+
+static struct tcp_congestion_ops tcp_bbr_cong_ops = {
+	.flags		= TCP_CONG_NON_RESTRICTED | TCP_CONG_RTT_STAMP,
+	.init		= bbr_init,
+	.ssthresh	= bbr_ssthresh,
+	.cong_control	= bbr_main,
+	.set_state	= bbr_set_state,
+	.cwnd_event	= bbr_cwnd_event,
+	.undo_cwnd	= bbr_undo_cwnd,
+
+	.owner		= THIS_MODULE,
+	.name		= "bbr",
+};
+
+static int __init bbr_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct bbr) > ICSK_CA_PRIV_SIZE);
+	return tcp_register_congestion_control(&tcp_bbr_cong_ops);
+}
+
+static void __exit bbr_unregister(void)
+{
+	tcp_unregister_congestion_control(&tcp_bbr_cong_ops);
+}
+
+module_init(bbr_register);
+module_exit(bbr_unregister);
+
+MODULE_AUTHOR("Van Jacobson, Neal Cardwell, Yuchung Cheng, Soheil Hassas Yeganeh");
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("TCP BBR (Bottleneck Bandwidth and RTT)");
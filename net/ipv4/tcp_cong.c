@@ -39,8 +39,11 @@ int tcp_register_congestion_control(struct tcp_congestion_ops *ca)
 {
 	int ret = 0;
 
-	/* all algorithms must implement ssthresh and cong_avoid ops */
-	if (!ca->ssthresh || !ca->cong_avoid) {
+	/* all algorithms must implement ssthresh and cong_avoid or
+	 * cong_control ops, the latter needs per skb timestamps
+	 */
+	if (!ca->ssthresh || !(ca->cong_avoid || ca->cong_control) ||
+	    (ca->cong_control && !(ca->flags & TCP_CONG_RTT_STAMP))) {
 		printk(KERN_ERR "TCP %s does not implement required ops\n",
 		       ca->name);
 		return -EINVAL;
@@ -74,25 +77,36 @@ void tcp_unregister_congestion_control(struct tcp_congestion_ops *ca)
 }
 EXPORT_SYMBOL_GPL(tcp_unregister_congestion_control);
 
-/* Assign choice of congestion control. */
-void tcp_init_congestion_control(struct sock *sk)
+/* Assign choice of congestion control.  This is done when the socket is
+ * created, so that modules needing ECN already see their flags on the SYN.
+ */
+void tcp_assign_congestion_control(struct sock *sk)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	struct tcp_congestion_ops *ca;
 
-	/* if no choice made yet assign the current value set as default */
-	if (icsk->icsk_ca_ops == &tcp_init_congestion_ops) {
-		rcu_read_lock();
-		list_for_each_entry_rcu(ca, &tcp_cong_list, list) {
-			if (try_module_get(ca->owner)) {
-				icsk->icsk_ca_ops = ca;
-				break;
-			}
+	icsk->icsk_ca_ops = &tcp_init_congestion_ops;
 
-			/* fallback to next available */
+	rcu_read_lock();
+	list_for_each_entry_rcu(ca, &tcp_cong_list, list) {
+		if (try_module_get(ca->owner)) {
+			icsk->icsk_ca_ops = ca;
+			break;
 		}
-		rcu_read_unlock();
+
+		/* fallback to next available */
 	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(tcp_assign_congestion_control);
+
+void tcp_init_congestion_control(struct sock *sk)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+
+	/* if no choice made yet assign the current value set as default */
+	if (icsk->icsk_ca_ops == &tcp_init_congestion_ops)
+		tcp_assign_congestion_control(sk);
 
 	if (icsk->icsk_ca_ops->init)
 		icsk->icsk_ca_ops->init(sk);
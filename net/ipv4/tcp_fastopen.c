@@ -0,0 +1,191 @@
+/*
+ * TCP Fast Open: data in the SYN of repeat connections.
+ *
+ * A server hands out a cookie derived from the client's address and a
+ * random secret.  A client that presents a valid cookie in a later SYN
+ * may carry data in it, which the server delivers to a child socket
+ * before the three-way handshake completes.
+ *
+ * This file holds the cookie generator used by the server and the
+ * cookie cache used by the client.
+ */
+
+#include <linux/kernel.h>
+#include <linux/hash.h>
+#include <linux/random.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <net/tcp.h>
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+#include <net/ipv6.h>
+#endif
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE | TFO_SERVER_ENABLE;
+
+/* Fast Open cookies are a MAC of the client's address keyed on a secret
+ * picked on first use and kept for the life of the system, so that a
+ * client can keep using its cookie for as long as it caches it.  The
+ * TCP Cookie Transactions secret rotates every few minutes and would
+ * cost such clients a regular handshake each time it moves on.
+ */
+static u32 tcp_fastopen_secret[SHA_MESSAGE_BYTES / 4 - 1];
+static int tcp_fastopen_secret_ready;
+static DEFINE_SPINLOCK(tcp_fastopen_secret_lock);
+
+static void tcp_fastopen_init_secret(void)
+{
+	spin_lock_bh(&tcp_fastopen_secret_lock);
+	if (!tcp_fastopen_secret_ready) {
+		get_random_bytes(tcp_fastopen_secret,
+				 sizeof(tcp_fastopen_secret));
+		smp_wmb();
+		tcp_fastopen_secret_ready = 1;
+	}
+	spin_unlock_bh(&tcp_fastopen_secret_lock);
+}
+
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	u32 digest[SHA_DIGEST_WORDS];
+	u32 message[SHA_MESSAGE_BYTES / 4];
+	u32 workspace[SHA_WORKSPACE_WORDS];
+
+	if (unlikely(!ACCESS_ONCE(tcp_fastopen_secret_ready)))
+		tcp_fastopen_init_secret();
+	smp_rmb();
+
+	message[0] = (__force u32)addr;
+	memcpy(&message[1], tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	sha_init(digest);
+	sha_transform(digest, (char *)message, workspace);
+	memcpy(foc->val, digest, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* Client side cookie cache.  It is direct mapped on the destination
+ * address: a collision simply evicts the older entry, which costs that
+ * destination one regular handshake to learn its cookie again.
+ */
+#define TCP_FASTOPEN_CACHE_BITS	8
+
+struct tcp_fastopen_cache_entry {
+	unsigned short			family;
+	union {
+		__be32			a4;
+		struct in6_addr		a6;
+	} daddr;
+	u16				mss;
+	u16				syn_loss;
+	unsigned long			last_syn_loss;
+	struct tcp_fastopen_cookie	cookie;
+};
+
+static struct tcp_fastopen_cache_entry
+	tcp_fastopen_cache[1 << TCP_FASTOPEN_CACHE_BITS];
+static DEFINE_SPINLOCK(tcp_fastopen_cache_lock);
+
+static struct tcp_fastopen_cache_entry *
+tcp_fastopen_cache_key(const struct sock *sk,
+		       struct tcp_fastopen_cache_entry *key)
+{
+	u32 hash;
+
+	memset(key, 0, sizeof(*key));
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	if (sk->sk_family == AF_INET6 &&
+	    !ipv6_addr_v4mapped(&inet6_sk(sk)->daddr)) {
+		const struct in6_addr *a6 = &inet6_sk(sk)->daddr;
+
+		key->family = AF_INET6;
+		ipv6_addr_copy(&key->daddr.a6, a6);
+		hash = (__force u32)(a6->s6_addr32[0] ^ a6->s6_addr32[1] ^
+				     a6->s6_addr32[2] ^ a6->s6_addr32[3]);
+	} else
+#endif
+	{
+		key->family = AF_INET;
+		key->daddr.a4 = inet_sk(sk)->inet_daddr;
+		hash = (__force u32)key->daddr.a4;
+	}
+	return &tcp_fastopen_cache[hash_32(hash, TCP_FASTOPEN_CACHE_BITS)];
+}
+
+static int tcp_fastopen_cache_match(const struct tcp_fastopen_cache_entry *e,
+				    const struct tcp_fastopen_cache_entry *key)
+{
+	return e->family == key->family &&
+	       !memcmp(&e->daddr, &key->daddr, sizeof(key->daddr));
+}
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct tcp_fastopen_cache_entry key, *e;
+
+	e = tcp_fastopen_cache_key(sk, &key);
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	if (tcp_fastopen_cache_match(e, &key)) {
+		if (e->mss)
+			*mss = e->mss;
+		*cookie = e->cookie;
+		*syn_loss = e->syn_loss;
+		*last_syn_loss = e->syn_loss ? e->last_syn_loss : 0;
+	}
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, int syn_lost)
+{
+	struct tcp_fastopen_cache_entry key, *e;
+
+	e = tcp_fastopen_cache_key(sk, &key);
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	if (!tcp_fastopen_cache_match(e, &key)) {
+		*e = key;
+		e->cookie.len = 0;
+	}
+	if (mss)
+		e->mss = mss;
+	if (cookie && cookie->len > 0)
+		e->cookie = *cookie;
+	if (syn_lost) {
+		/* Bounds the back off in tcp_send_syn_data() */
+		if (e->syn_loss < 8)
+			e->syn_loss++;
+		e->last_syn_loss = jiffies;
+	} else
+		e->syn_loss = 0;
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+/* A passive Fast Open child is done with its request_sock once the
+ * handshake completes or the socket is closed.  Drop it together with
+ * the listener reference and the listener's pending count.
+ */
+void tcp_fastopen_remove(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct request_sock *req = tp->fastopen_rsk;
+	struct sock *lsk;
+
+	if (req == NULL)
+		return;
+
+	tp->fastopen_rsk = NULL;
+	lsk = tcp_rsk(req)->listener;
+	atomic_dec(&inet_csk(lsk)->icsk_accept_queue.fastopen_qlen);
+	sock_put(lsk);
+	reqsk_free(req);
+}
+
+void tcp_free_fastopen_req(struct tcp_sock *tp)
+{
+	if (tp->fastopen_req != NULL) {
+		kfree(tp->fastopen_req);
+		tp->fastopen_req = NULL;
+	}
+}
@@ -72,6 +72,7 @@
 #include <net/timewait_sock.h>
 #include <net/xfrm.h>
 #include <net/netdma.h>
+#include <net/busy_poll.h>
 
 #include <linux/inet.h>
 #include <linux/ipv6.h>
@@ -445,12 +446,12 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 	}
 
 	switch (sk->sk_state) {
-		struct request_sock *req, **prev;
+		struct request_sock *req;
 	case TCP_LISTEN:
 		if (sock_owned_by_user(sk))
 			goto out;
 
-		req = inet_csk_search_req(sk, &prev, th->dest,
+		req = inet_csk_search_req(sk, th->dest,
 					  iph->daddr, iph->saddr);
 		if (!req)
 			goto out;
@@ -462,6 +463,7 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 
 		if (seq != tcp_rsk(req)->snt_isn) {
 			NET_INC_STATS_BH(net, LINUX_MIB_OUTOFWINDOWICMPS);
+			reqsk_put(req);
 			goto out;
 		}
 
@@ -471,7 +473,8 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 		 * created socket, and POSIX does not want network
 		 * errors returned from accept().
 		 */
-		inet_csk_reqsk_queue_drop(sk, req, prev);
+		inet_csk_reqsk_queue_drop(sk, req);
+		reqsk_put(req);
 		goto out;
 
 	case TCP_SYN_SENT:
@@ -1219,10 +1222,153 @@ static struct timewait_sock_ops tcp_timewait_sock_ops = {
 	.twsk_destructor= tcp_twsk_destructor,
 };
 
+/* Decide whether the data in this SYN may be accepted before the 3WHS
+ * completes.  Otherwise @valid_foc is filled in with the cookie the
+ * client should use next time, unless it did not ask for Fast Open.
+ */
+static int tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
+			      struct request_sock *req,
+			      struct tcp_fastopen_cookie *foc,
+			      struct tcp_fastopen_cookie *valid_foc)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	int skip_cookie = 0;
+
+	if (likely(foc->len < 0)) {
+		if ((sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_REQD) &&
+		    TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1)
+			skip_cookie = 1; /* no cookie to validate */
+		else
+			return 0;
+	}
+
+	/* Make sure the listener has enabled Fast Open and we don't exceed
+	 * its limit on pending children before validating the cookie, so as
+	 * not to burn cycles on SYNs we would not accept anyway.
+	 */
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    queue->fastopen_max_qlen == 0)
+		return 0;
+
+	if (atomic_read(&queue->fastopen_qlen) >= queue->fastopen_max_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return 0;
+	}
+
+	if (skip_cookie) {
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return 1;
+	}
+
+	if (foc->len == TCP_FASTOPEN_COOKIE_SIZE) {
+		if (!(sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_CHKED)) {
+			tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, valid_foc);
+			if (valid_foc->len != TCP_FASTOPEN_COOKIE_SIZE ||
+			    memcmp(foc->val, valid_foc->val,
+				   TCP_FASTOPEN_COOKIE_SIZE) != 0) {
+				NET_INC_STATS_BH(sock_net(sk),
+					LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+				return 0;
+			}
+			/* The client has it already, no need to echo it */
+			valid_foc->len = -1;
+		}
+		/* Acknowledge the data received from the peer. */
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return 1;
+	}
+
+	if (foc->len == 0)
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+	/* A cookie request, or a cookie of the wrong size which is treated
+	 * like an invalid one: either way hand out a valid cookie.
+	 */
+	tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, valid_foc);
+	return 0;
+}
+
+/* Create the child of a Fast Open SYN right away and put it on the
+ * accept queue, with the data of the SYN ready to be read.  The child
+ * keeps its own copy of @req to retransmit the SYN-ACK from until the
+ * 3WHS completes, @req itself goes to the accept queue.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct request_sock *req,
+				    struct dst_entry *dst,
+				    struct request_values *rvp)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct request_sock *fo_req;
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	fo_req = reqsk_alloc(req->rsk_ops);
+	if (fo_req == NULL)
+		return -1;
+
+	child = tcp_v4_syn_recv_sock(sk, skb, req, NULL);
+	if (child == NULL) {
+		__reqsk_free(fo_req);
+		return -1;
+	}
+	tp = tcp_sk(child);
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never scaled. */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+	tp->max_window = tp->snd_wnd;
+
+	/* Finish what tcp_rcv_state_process() would do on the final ACK */
+	inet_csk(child)->icsk_af_ops->rebuild_header(child);
+	tcp_init_metrics(child);
+	tcp_init_congestion_control(child);
+	tp->lsndtime = tcp_time_stamp;
+	tcp_mtup_init(child);
+	tcp_init_buffer_space(child);
+
+	/* Queue the data carried in the SYN.  The caller frees its own
+	 * reference to the skb.  Without room for it the SYN-ACK only
+	 * acknowledges the SYN and the client sends the data again.
+	 */
+	if (TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1) {
+		if (sk_rmem_schedule(child, skb->truesize)) {
+			skb = skb_get(skb);
+			skb_dst_drop(skb);
+			__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+			skb_set_owner_r(skb, child);
+			__skb_queue_tail(&child->sk_receive_queue, skb);
+		} else {
+			tcp_rsk(req)->rcv_nxt = tcp_rsk(req)->rcv_isn + 1;
+		}
+	}
+	tp->rcv_nxt = tp->rcv_wup = tcp_rsk(req)->rcv_nxt;
+
+	memcpy(fo_req, req, req->rsk_ops->obj_size);
+	tcp_rsk(fo_req)->listener = sk;
+	sock_hold(sk);
+	atomic_inc(&queue->fastopen_qlen);
+	tp->fastopen_rsk = fo_req;
+
+	/* Retransmit the SYN-ACK, not the data, until it is acknowledged */
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	tcp_v4_send_synack(sk, dst, req, rvp);
+
+	if (inet_csk_reqsk_queue_add(sk, req, child) == NULL)
+		return 0;
+	sk->sk_data_ready(sk, 0);
+	bh_unlock_sock(child);
+	sock_put(child);
+	return 0;
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_extend_values tmp_ext;
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
 	u8 *hash_location;
 	struct request_sock *req;
 	struct inet_request_sock *ireq;
@@ -1273,7 +1419,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0, &foc);
 
 	if (tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
@@ -1327,7 +1473,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 		goto drop_and_free;
 
 	if (!want_cookie)
-		TCP_ECN_create_request(req, tcp_hdr(skb));
+		TCP_ECN_create_request(req, tcp_hdr(skb), sk);
 
 	if (want_cookie) {
 #ifdef CONFIG_SYN_COOKIES
@@ -1381,6 +1527,23 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	}
 	tcp_rsk(req)->snt_isn = isn;
 
+	tmp_ext.fastopen_cookie = NULL;
+	if (!want_cookie &&
+	    tcp_fastopen_check(sk, skb, req, &foc, &valid_foc)) {
+		if (valid_foc.len > 0)
+			tmp_ext.fastopen_cookie = &valid_foc;
+		if (!tcp_v4_conn_req_fastopen(sk, skb, req, dst,
+				(struct request_values *)&tmp_ext)) {
+			NET_INC_STATS_BH(sock_net(sk),
+					 LINUX_MIB_TCPFASTOPENPASSIVE);
+			return 0;
+		}
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		tcp_rsk(req)->rcv_nxt = tcp_rsk(req)->rcv_isn + 1;
+	} else if (valid_foc.len > 0) {
+		tmp_ext.fastopen_cookie = &valid_foc;
+	}
+
 	if (tcp_v4_send_synack(sk, dst, req,
 			       (struct request_values *)&tmp_ext) ||
 	    want_cookie)
@@ -1418,11 +1581,11 @@ struct sock *tcp_v4_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 		goto exit_overflow;
 
 	if (!dst && (dst = inet_csk_route_req(sk, req)) == NULL)
-		goto exit;
+		goto exit_nonewsk;
 
 	newsk = tcp_create_openreq_child(sk, req, skb);
 	if (!newsk)
-		goto exit;
+		goto exit_nonewsk;
 
 	newsk->sk_gso_type = SKB_GSO_TCPV4;
 	sk_setup_caps(newsk, dst);
@@ -1470,16 +1633,22 @@ struct sock *tcp_v4_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 #endif
 
 	__inet_hash_nolisten(newsk, NULL);
-	__inet_inherit_port(sk, newsk);
+	if (__inet_inherit_port(sk, newsk) < 0)
+		goto put_and_exit;
 
 	return newsk;
 
 exit_overflow:
 	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_LISTENOVERFLOWS);
+exit_nonewsk:
+	dst_release(dst);
 exit:
 	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_LISTENDROPS);
-	dst_release(dst);
 	return NULL;
+put_and_exit:
+	inet_csk_prepare_forced_close(newsk);
+	tcp_done(newsk);
+	goto exit;
 }
 
 static struct sock *tcp_v4_hnd_req(struct sock *sk, struct sk_buff *skb)
@@ -1487,12 +1656,14 @@ static struct sock *tcp_v4_hnd_req(struct sock *sk, struct sk_buff *skb)
 	struct tcphdr *th = tcp_hdr(skb);
 	const struct iphdr *iph = ip_hdr(skb);
 	struct sock *nsk;
-	struct request_sock **prev;
 	/* Find possible connection requests. */
-	struct request_sock *req = inet_csk_search_req(sk, &prev, th->source,
+	struct request_sock *req = inet_csk_search_req(sk, th->source,
 						       iph->saddr, iph->daddr);
-	if (req)
-		return tcp_check_req(sk, skb, req, prev);
+	if (req) {
+		nsk = tcp_check_req(sk, skb, req);
+		reqsk_put(req);
+		return nsk;
+	}
 
 	nsk = inet_lookup_established(sock_net(sk), &tcp_hashinfo, iph->saddr,
 			th->source, iph->daddr, th->dest, inet_iif(skb));
@@ -1543,6 +1714,25 @@ static __sum16 tcp_v4_checksum_init(struct sk_buff *skb)
  * This is because we cannot sleep with the original spinlock
  * held.
  */
+/*
+ * Segments for a listening socket are processed without its lock, so that
+ * SYN floods and accept() bound servers scale with the number of receive
+ * queues: the SYN table and the accept queue have their own locking.  MD5
+ * keys and cookie transactions have none, listeners using them are still
+ * serialized on the socket lock.
+ */
+static inline int tcp_listen_lockless(const struct sock *sk)
+{
+	/* IPv6 listeners, dual-stack ones included, keep the lock */
+	if (sk->sk_family != AF_INET)
+		return 0;
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_sk(sk)->md5sig_info != NULL)
+		return 0;
+#endif
+	return tcp_sk(sk)->cookie_values == NULL;
+}
+
 int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 {
 	struct sock *rsk;
@@ -1558,6 +1748,20 @@ int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 #endif
 
 	if (sk->sk_state == TCP_ESTABLISHED) { /* Fast path */
+		struct dst_entry *dst = sk->sk_rx_dst;
+
+		sock_rps_save_rxhash(sk, skb->rxhash);
+		if (dst) {
+			if (inet_sk(sk)->rx_dst_ifindex != skb->skb_iif ||
+			    dst_check(dst, 0) == NULL) {
+				dst_release(dst);
+				sk->sk_rx_dst = NULL;
+			}
+		}
+		if (!sk->sk_rx_dst && skb_dst(skb)) {
+			sk->sk_rx_dst = dst_clone(skb_dst(skb));
+			inet_sk(sk)->rx_dst_ifindex = skb->skb_iif;
+		}
 		TCP_CHECK_TIMER(sk);
 		if (tcp_rcv_established(sk, skb, tcp_hdr(skb), skb->len)) {
 			rsk = sk;
@@ -1576,13 +1780,15 @@ int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 			goto discard;
 
 		if (nsk != sk) {
+			sock_rps_save_rxhash(nsk, skb->rxhash);
 			if (tcp_child_process(sk, nsk, skb)) {
 				rsk = nsk;
 				goto reset;
 			}
 			return 0;
 		}
-	}
+	} else
+		sock_rps_save_rxhash(sk, skb->rxhash);
 
 	TCP_CHECK_TIMER(sk);
 	if (tcp_rcv_state_process(sk, skb, tcp_hdr(skb), skb->len)) {
@@ -1608,6 +1814,69 @@ csum_err:
 	goto discard;
 }
 
+static void tcp_v4_edemux_destructor(struct sk_buff *skb)
+{
+	struct sock *sk = skb->sk;
+
+	if (sk->sk_state == TCP_TIME_WAIT)
+		inet_twsk_put(inet_twsk(sk));
+	else
+		sock_put(sk);
+}
+
+/* Called from ip_rcv_finish() before the input route lookup.  If the
+ * packet belongs to an established socket, attach the socket to the skb
+ * (tcp_v4_rcv() picks it up through skb_steal_sock()) together with the
+ * input route it cached.
+ */
+void tcp_v4_early_demux(struct sk_buff *skb)
+{
+	struct net *net = dev_net(skb->dev);
+	const struct iphdr *iph;
+	const struct tcphdr *th;
+	struct sock *sk;
+
+	if (skb->pkt_type != PACKET_HOST)
+		return;
+
+	if (!pskb_may_pull(skb, ip_hdrlen(skb) + sizeof(struct tcphdr)))
+		return;
+
+	iph = ip_hdr(skb);
+	if (iph->frag_off & htons(IP_MF | IP_OFFSET))
+		return;
+
+	th = (struct tcphdr *)((char *)iph + ip_hdrlen(skb));
+	if (th->doff < sizeof(struct tcphdr) / 4)
+		return;
+
+	sk = __inet_lookup_established(net, &tcp_hashinfo,
+				       iph->saddr, th->source,
+				       iph->daddr, ntohs(th->dest),
+				       skb->skb_iif);
+	if (!sk)
+		return;
+
+	skb->sk = sk;
+	skb->destructor = tcp_v4_edemux_destructor;
+	if (sk->sk_state != TCP_TIME_WAIT) {
+		struct dst_entry *dst;
+
+		/* tcp_v4_do_rcv() replaces sk_rx_dst under the socket lock,
+		 * from softirq or from the backlog of the lock owner.
+		 */
+		bh_lock_sock(sk);
+		if (!sock_owned_by_user(sk)) {
+			dst = sk->sk_rx_dst;
+			if (dst)
+				dst = dst_check(dst, 0);
+			if (dst && inet_sk(sk)->rx_dst_ifindex == skb->skb_iif)
+				skb_dst_set(skb, dst_clone(dst));
+		}
+		bh_unlock_sock(sk);
+	}
+}
+
 /*
  *	From tcp_input.c
  */
@@ -1673,8 +1942,15 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_listen_lockless(sk)) {
+		ret = tcp_v4_do_rcv(sk, skb);
+		sock_put(sk);
+		return ret;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1736,6 +2012,7 @@ do_time_wait:
 	case TCP_TW_SYN: {
 		struct sock *sk2 = inet_lookup_listener(dev_net(skb->dev),
 							&tcp_hashinfo,
+							iph->saddr, th->source,
 							iph->daddr, th->dest,
 							inet_iif(skb));
 		if (sk2) {
@@ -1825,6 +2102,7 @@ const struct inet_connection_sock_af_ops ipv4_specific = {
 	.setsockopt	   = ip_setsockopt,
 	.getsockopt	   = ip_getsockopt,
 	.addr2sockaddr	   = inet_csk_addr2sockaddr,
+	.recv_error	   = ip_recv_error,
 	.sockaddr_len	   = sizeof(struct sockaddr_in),
 	.bind_conflict	   = inet_csk_bind_conflict,
 #ifdef CONFIG_COMPAT
@@ -1872,7 +2150,8 @@ static int tcp_v4_init_sock(struct sock *sk)
 	tp->mss_cache = TCP_MSS_DEFAULT;
 
 	tp->reordering = sysctl_tcp_reordering;
-	icsk->icsk_ca_ops = &tcp_init_congestion_ops;
+	tcp_enable_early_retrans(tp);
+	tcp_assign_congestion_control(sk);
 
 	sk->sk_state = TCP_CLOSE;
 
@@ -1922,6 +2201,12 @@ void tcp_v4_destroy_sock(struct sock *sk)
 	/* Cleans up our, hopefully empty, out_of_order_queue. */
 	__skb_queue_purge(&tp->out_of_order_queue);
 
+	/* Socket aborted during a Fast Open connect, or a Fast Open
+	 * child destroyed before its 3WHS completed.
+	 */
+	tcp_free_fastopen_req(tp);
+	tcp_fastopen_remove(sk);
+
 #ifdef CONFIG_TCP_MD5SIG
 	/* Clean up the MD5 key list, if any */
 	if (tp->md5sig_info) {
@@ -2333,7 +2618,9 @@ static void get_tcp4_sock(struct sock *sk, struct seq_file *f, int i, int *len)
 	__u16 srcp = ntohs(inet->inet_sport);
 	int rx_queue;
 
-	if (icsk->icsk_pending == ICSK_TIME_RETRANS) {
+	if (icsk->icsk_pending == ICSK_TIME_RETRANS ||
+	    icsk->icsk_pending == ICSK_TIME_EARLY_RETRANS ||
+	    icsk->icsk_pending == ICSK_TIME_LOSS_PROBE) {
 		timer_active	= 1;
 		timer_expires	= icsk->icsk_timeout;
 	} else if (icsk->icsk_pending == ICSK_TIME_PROBE0) {
@@ -2517,6 +2804,7 @@ struct proto tcp_prot = {
 	.getsockopt		= tcp_getsockopt,
 	.recvmsg		= tcp_recvmsg,
 	.backlog_rcv		= tcp_v4_do_rcv,
+	.release_cb		= tcp_release_cb,
 	.hash			= inet_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
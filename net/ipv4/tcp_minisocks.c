@@ -98,7 +98,7 @@ tcp_timewait_state_process(struct inet_timewait_sock *tw, struct sk_buff *skb,
 
 	tmp_opt.saw_tstamp = 0;
 	if (th->doff > (sizeof(*th) >> 2) && tcptw->tw_ts_recent_stamp) {
-		tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+		tcp_parse_options(skb, &tmp_opt, &hash_location, 0, NULL);
 
 		if (tmp_opt.saw_tstamp) {
 			tmp_opt.ts_recent	= tcptw->tw_ts_recent;
@@ -448,8 +448,14 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct request_sock *req,
 
 		newtp->frto_counter = 0;
 		newtp->frto_highmark = 0;
+		newtp->tlp_high_seq = 0;
+		tcp_enable_early_retrans(newtp);
 
-		newicsk->icsk_ca_ops = &tcp_init_congestion_ops;
+		/* Keep the listener's congestion control, so that modules
+		 * requiring ECN see it negotiated on the child as well.
+		 */
+		if (!try_module_get(newicsk->icsk_ca_ops->owner))
+			tcp_assign_congestion_control(newsk);
 
 		tcp_set_ca_state(newsk, TCP_CA_Open);
 		tcp_init_xmit_timers(newsk);
@@ -464,6 +470,12 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct request_sock *req,
 
 		newtp->urg_data = 0;
 
+		newtp->fastopen_req = NULL;
+		newtp->fastopen_rsk = NULL;
+		newtp->syn_fastopen = 0;
+		newtp->syn_data = 0;
+		newtp->syn_data_acked = 0;
+
 		if (sock_flag(newsk, SOCK_KEEPOPEN))
 			inet_csk_reset_keepalive_timer(newsk,
 						       keepalive_time_when(newtp));
@@ -517,8 +529,7 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct request_sock *req,
  */
 
 struct sock *tcp_check_req(struct sock *sk, struct sk_buff *skb,
-			   struct request_sock *req,
-			   struct request_sock **prev)
+			   struct request_sock *req)
 {
 	struct tcp_options_received tmp_opt;
 	u8 *hash_location;
@@ -529,7 +540,7 @@ struct sock *tcp_check_req(struct sock *sk, struct sk_buff *skb,
 
 	tmp_opt.saw_tstamp = 0;
 	if (th->doff > (sizeof(struct tcphdr)>>2)) {
-		tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+		tcp_parse_options(skb, &tmp_opt, &hash_location, 0, NULL);
 
 		if (tmp_opt.saw_tstamp) {
 			tmp_opt.ts_recent = req->ts_recent;
@@ -680,18 +691,22 @@ struct sock *tcp_check_req(struct sock *sk, struct sk_buff *skb,
 	 * the tests. THIS SEGMENT MUST MOVE SOCKET TO
 	 * ESTABLISHED STATE. If it will be dropped after
 	 * socket is created, wait for troubles.
+	 *
+	 * The listener is not locked: claim the request first, so that
+	 * a retransmitted ACK processed on another CPU meanwhile does
+	 * not create a second child.
 	 */
+	if (!inet_csk_reqsk_queue_claim(sk, req))
+		return NULL;
+
 	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, NULL);
 	if (child == NULL)
 		goto listen_overflow;
 
-	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
-
-	inet_csk_reqsk_queue_add(sk, req, child);
-	return child;
+	return inet_csk_reqsk_queue_complete(sk, req, child);
 
 listen_overflow:
+	inet_csk_reqsk_queue_unclaim(sk, req);
 	if (!sysctl_tcp_abort_on_overflow) {
 		inet_rsk(req)->acked = 1;
 		return NULL;
@@ -702,7 +717,7 @@ embryonic_reset:
 	if (!(flg & TCP_FLAG_RST))
 		req->rsk_ops->send_reset(sk, skb);
 
-	inet_csk_reqsk_queue_drop(sk, req, prev);
+	inet_csk_reqsk_queue_drop(sk, req);
 	return NULL;
 }
 
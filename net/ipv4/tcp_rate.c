@@ -0,0 +1,147 @@
+/*
+ * TCP delivery rate sampling.
+ *
+ * For every ACK we estimate the rate at which the network delivered this
+ * flow's data packets, measured over the interval between the transmission
+ * of a packet and its (selective) acknowledgment:
+ *
+ *    send_rate = #pkts_delivered / (last_snd_time - first_snd_time)
+ *    ack_rate  = #pkts_delivered / (last_ack_time - first_ack_time)
+ *    bw = min(send_rate, ack_rate)
+ *
+ * Taking the slower of the two phases keeps ACK compression or stretched
+ * ACKs from reporting packets delivered faster than the bottleneck could
+ * possibly have carried them.  The result is the flow's goodput, which is
+ * lower than the path's bottleneck rate while the sender or receiver is the
+ * limiting factor.  To help congestion control tell the two apart, a sample
+ * is marked application-limited if at some point during its window there
+ * was nothing in the write queue to send.
+ *
+ * Rate samples are only generated for congestion control modules that
+ * implement cong_control(), and rely on the skb->tstamp taken for
+ * TCP_CONG_RTT_STAMP.
+ */
+
+#include <linux/kernel.h>
+#include <net/tcp.h>
+
+/* Snapshot the current delivery information in the skb, to generate
+ * a rate sample later when the skb is (s)acked in tcp_rate_skb_delivered().
+ */
+void tcp_rate_skb_sent(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_skb_cb *scb = TCP_SKB_CB(skb);
+
+	/* In general a sample starts at the most recent ACK, so that it
+	 * covers the full time the network needs to deliver everything in
+	 * flight.  With nothing in flight, any later ACK shows the network
+	 * delivered those packets completely between now and that ACK.
+	 *
+	 * packets_out is used rather than tcp_packets_in_flight() since the
+	 * latter depends on loss marking heuristics, and a spurious RTO or
+	 * loss mark must not shrink the interval and inflate the estimate.
+	 */
+	if (!tp->packets_out) {
+		tp->first_tx_mstamp = skb->tstamp;
+		tp->delivered_mstamp = skb->tstamp;
+	}
+
+	scb->tx.first_tx_mstamp = tp->first_tx_mstamp;
+	scb->tx.delivered_mstamp = tp->delivered_mstamp;
+	scb->tx.delivered = tp->delivered;
+	scb->tx.is_app_limited = tp->app_limited ? 1 : 0;
+}
+
+/* When an skb is sacked or acked, fill in the rate sample with the
+ * delivery information from when the skb was last transmitted.
+ *
+ * An ACK (s)acking several skbs calls this once per skb; we keep the
+ * information of the most recently sent one, i.e. the skb with the
+ * highest prior delivered count.
+ */
+void tcp_rate_skb_delivered(struct sock *sk, struct sk_buff *skb,
+			    struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_skb_cb *scb = TCP_SKB_CB(skb);
+
+	if (!scb->tx.delivered_mstamp.tv64)
+		return;
+
+	if (!rs->prior_delivered ||
+	    after(scb->tx.delivered, rs->prior_delivered)) {
+		rs->prior_delivered = scb->tx.delivered;
+		rs->prior_mstamp = scb->tx.delivered_mstamp;
+		rs->is_app_limited = scb->tx.is_app_limited;
+		rs->is_retrans = scb->sacked & TCPCB_RETRANS;
+
+		/* Find the duration of the "send phase" of this window */
+		rs->interval_us = ktime_us_delta(skb->tstamp,
+						 scb->tx.first_tx_mstamp);
+
+		/* Record send time of most recently ACKed packet */
+		tp->first_tx_mstamp = skb->tstamp;
+	}
+	/* Mark the skb off once it is sacked, so the cumulative ACK that
+	 * follows does not use it again.  Acked skbs are freed right away.
+	 */
+	if (scb->sacked & TCPCB_SACKED_ACKED)
+		scb->tx.delivered_mstamp.tv64 = 0;
+}
+
+/* Update the connection delivery information and generate a rate sample.
+ * Normally interval_us is at least one RTT, callers are expected to
+ * discard samples shorter than their min RTT: such a sample comes from a
+ * spuriously retransmitted skb and overestimates the rate.
+ */
+void tcp_rate_gen(struct sock *sk, u32 delivered, u32 lost,
+		  struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	ktime_t now = ktime_get_real();
+	long snd_us, ack_us;
+
+	/* Clear app limited if bubble is acked and gone. */
+	if (tp->app_limited && after(tp->delivered, tp->app_limited))
+		tp->app_limited = 0;
+
+	if (delivered)
+		tp->delivered_mstamp = now;
+
+	rs->acked_sacked = delivered;	/* freshly ACKed or SACKed */
+	rs->losses = lost;		/* freshly marked lost */
+	/* Return an invalid sample if no timing information is available. */
+	if (!rs->prior_mstamp.tv64) {
+		rs->delivered = -1;
+		rs->interval_us = -1;
+		return;
+	}
+	rs->delivered = tp->delivered - rs->prior_delivered;
+
+	/* Model sending data and receiving ACKs as separate pipeline phases
+	 * for a window.  Usually the ACK phase is longer, but with ACK
+	 * compression the send phase can be longer.  To be safe we use the
+	 * longer phase.
+	 */
+	snd_us = rs->interval_us;
+	ack_us = ktime_us_delta(now, rs->prior_mstamp);
+	rs->interval_us = max(snd_us, ack_us);
+}
+
+/* If a gap is detected between sends, mark the socket application-limited. */
+void tcp_rate_check_app_limited(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (/* We have less than one packet to send. */
+	    tp->write_seq - tp->snd_nxt < tp->mss_cache &&
+	    /* Nothing in sending host's qdisc queues or NIC tx queue. */
+	    sk_wmem_alloc_get(sk) < SKB_DATA_ALIGN(1) + sizeof(struct sk_buff) &&
+	    /* We are not limited by CWND. */
+	    tcp_packets_in_flight(tp) < tp->snd_cwnd &&
+	    /* All lost packets have been retransmitted. */
+	    tp->lost_out <= tp->retrans_out)
+		tp->app_limited =
+			(tp->delivered + tcp_packets_in_flight(tp)) ? : 1;
+}
@@ -167,12 +167,19 @@ static bool retransmits_timed_out(struct sock *sk,
 static int tcp_write_timeout(struct sock *sk)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
 	int retry_until;
 	bool do_reset;
 
 	if ((1 << sk->sk_state) & (TCPF_SYN_SENT | TCPF_SYN_RECV)) {
-		if (icsk->icsk_retransmits)
+		if (icsk->icsk_retransmits) {
 			dst_negative_advice(&sk->sk_dst_cache, sk);
+			/* Remember the loss of a Fast Open SYN, a path
+			 * that drops them gets regular SYNs for a while.
+			 */
+			if (tp->syn_fastopen || tp->syn_data)
+				tcp_fastopen_cache_set(sk, 0, NULL, 1);
+		}
 		retry_until = icsk->icsk_syn_retries ? : sysctl_tcp_syn_retries;
 	} else {
 		if (retransmits_timed_out(sk, sysctl_tcp_retries1)) {
@@ -309,6 +316,29 @@ static void tcp_probe_timer(struct sock *sk)
 	}
 }
 
+/* The SYN-ACK of a Fast Open child is not on the write queue, so it is
+ * resent from its request_sock until the 3WHS completes.
+ */
+static void tcp_fastopen_synack_timer(struct sock *sk)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct request_sock *req = tcp_sk(sk)->fastopen_rsk;
+	/* one more retry than usual, the child may already be accepted */
+	int max_retries = icsk->icsk_syn_retries ? :
+			  sysctl_tcp_synack_retries + 1;
+
+	req->rsk_ops->syn_ack_timeout(sk, req);
+
+	if (req->retrans >= max_retries) {
+		tcp_write_err(sk);
+		return;
+	}
+	req->rsk_ops->rtx_syn_ack(sk, req, NULL);
+	req->retrans++;
+	inet_csk_reset_xmit_timer(sk, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT << req->retrans, TCP_RTO_MAX);
+}
+
 /*
  *	The TCP retransmit timer.
  */
@@ -318,6 +348,14 @@ void tcp_retransmit_timer(struct sock *sk)
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct inet_connection_sock *icsk = inet_csk(sk);
 
+	if (tp->fastopen_rsk) {
+		/* Nothing else is retransmitted before the SYN-ACK is
+		 * acknowledged.
+		 */
+		tcp_fastopen_synack_timer(sk);
+		return;
+	}
+
 	if (!tp->packets_out)
 		goto out;
 
@@ -468,6 +506,12 @@ static void tcp_write_timer(unsigned long data)
 	icsk->icsk_pending = 0;
 
 	switch (event) {
+	case ICSK_TIME_EARLY_RETRANS:
+		tcp_resume_early_retransmit(sk);
+		break;
+	case ICSK_TIME_LOSS_PROBE:
+		tcp_send_loss_probe(sk);
+		break;
 	case ICSK_TIME_RETRANS:
 		tcp_retransmit_timer(sk);
 		break;
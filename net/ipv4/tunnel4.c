@@ -82,6 +82,9 @@ static int tunnel4_rcv(struct sk_buff *skb)
 	if (!pskb_may_pull(skb, sizeof(struct iphdr)))
 		goto drop;
 
+	/* GRO merged the inner packets; the tunnel header goes away here. */
+	skb_shinfo(skb)->gso_type &= ~SKB_GSO_TUNNEL;
+
 	for (handler = tunnel4_handlers; handler; handler = handler->next)
 		if (!handler->handler(skb))
 			return 0;
@@ -133,9 +136,17 @@ static void tunnel64_err(struct sk_buff *skb, u32 info)
 }
 #endif
 
+static int tunnel4_gro_complete(struct sk_buff *skb)
+{
+	return inet_encap_gro_complete(skb, ip_hdrlen(skb));
+}
+
 static const struct net_protocol tunnel4_protocol = {
 	.handler	=	tunnel4_rcv,
 	.err_handler	=	tunnel4_err,
+	.gso_segment	=	inet_encap_gso_segment,
+	.gro_receive	=	inet_encap_gro_receive,
+	.gro_complete	=	tunnel4_gro_complete,
 	.no_policy	=	1,
 	.netns_ok	=	1,
 };
@@ -105,6 +105,7 @@
 #include <net/route.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/busy_poll.h>
 #include "udp_impl.h"
 
 struct udp_table udp_table __read_mostly;
@@ -119,9 +120,12 @@ EXPORT_SYMBOL(sysctl_udp_rmem_min);
 int sysctl_udp_wmem_min __read_mostly;
 EXPORT_SYMBOL(sysctl_udp_wmem_min);
 
-atomic_t udp_memory_allocated;
+struct percpu_counter udp_memory_allocated;
 EXPORT_SYMBOL(udp_memory_allocated);
 
+/* Set once a socket enables UDP_GRO; until then GRO skips the lookup. */
+static int udp_gro_needed __read_mostly;
+
 #define MAX_UDP_PORTS 65536
 #define PORTS_PER_CHAIN (MAX_UDP_PORTS / UDP_HTABLE_SIZE_MIN)
 
@@ -135,12 +139,15 @@ static int udp_lib_lport_inuse(struct net *net, __u16 num,
 {
 	struct sock *sk2;
 	struct hlist_nulls_node *node;
+	int uid = sock_i_uid(sk);
 
 	sk_nulls_for_each(sk2, node, &hslot->head)
 		if (net_eq(sock_net(sk2), net) &&
 		    sk2 != sk &&
 		    (bitmap || udp_sk(sk2)->udp_port_hash == num) &&
 		    (!sk2->sk_reuse || !sk->sk_reuse) &&
+		    (!sk2->sk_reuseport || !sk->sk_reuseport ||
+		     uid != sock_i_uid(sk2)) &&
 		    (!sk2->sk_bound_dev_if || !sk->sk_bound_dev_if ||
 		     sk2->sk_bound_dev_if == sk->sk_bound_dev_if) &&
 		    (*saddr_comp)(sk, sk2)) {
@@ -165,6 +172,7 @@ static int udp_lib_lport_inuse2(struct net *net, __u16 num,
 {
 	struct sock *sk2;
 	struct hlist_nulls_node *node;
+	int uid = sock_i_uid(sk);
 	int res = 0;
 
 	spin_lock(&hslot2->lock);
@@ -173,6 +181,8 @@ static int udp_lib_lport_inuse2(struct net *net, __u16 num,
 		    sk2 != sk &&
 		    (udp_sk(sk2)->udp_port_hash == num) &&
 		    (!sk2->sk_reuse || !sk->sk_reuse) &&
+		    (!sk2->sk_reuseport || !sk->sk_reuseport ||
+		     uid != sock_i_uid(sk2)) &&
 		    (!sk2->sk_bound_dev_if || !sk->sk_bound_dev_if ||
 		     sk2->sk_bound_dev_if == sk->sk_bound_dev_if) &&
 		    (*saddr_comp)(sk, sk2)) {
@@ -404,7 +414,8 @@ static struct sock *udp4_lib_lookup2(struct net *net,
 {
 	struct sock *sk, *result;
 	struct hlist_nulls_node *node;
-	int score, badness;
+	int score, badness, matches = 0, reuseport = 0;
+	u32 hash = 0;
 
 begin:
 	result = NULL;
@@ -415,8 +426,18 @@ begin:
 		if (score > badness) {
 			result = sk;
 			badness = score;
-			if (score == SCORE2_MAX)
+			reuseport = sk->sk_reuseport;
+			if (reuseport) {
+				hash = inet_ehashfn(net, daddr, hnum,
+						    saddr, sport);
+				matches = 1;
+			} else if (score == SCORE2_MAX)
 				goto exact_match;
+		} else if (score == badness && reuseport) {
+			matches++;
+			if (((u64)hash * matches) >> 32 == 0)
+				result = sk;
+			hash = next_pseudo_random32(hash);
 		}
 	}
 	/*
@@ -452,7 +473,8 @@ static struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 	unsigned short hnum = ntohs(dport);
 	unsigned int hash2, slot2, slot = udp_hashfn(net, hnum, udptable->mask);
 	struct udp_hslot *hslot2, *hslot = &udptable->hash[slot];
-	int score, badness;
+	int score, badness, matches = 0, reuseport = 0;
+	u32 hash = 0;
 
 	rcu_read_lock();
 	if (hslot->count > 10) {
@@ -488,6 +510,21 @@ begin:
 		if (score > badness) {
 			result = sk;
 			badness = score;
+			reuseport = sk->sk_reuseport;
+			if (reuseport) {
+				hash = inet_ehashfn(net, daddr, hnum,
+						    saddr, sport);
+				matches = 1;
+			}
+		} else if (score == badness && reuseport) {
+			/*
+			 * Spread flows over the SO_REUSEPORT group by
+			 * source address and port.
+			 */
+			matches++;
+			if (((u64)hash * matches) >> 32 == 0)
+				result = sk;
+			hash = next_pseudo_random32(hash);
 		}
 	}
 	/*
@@ -702,6 +739,34 @@ static void udp4_hwcsum_outgoing(struct sock *sk, struct sk_buff *skb,
 	}
 }
 
+/*
+ * Turn the pending data of a UDP_SEGMENT send into a GSO skb that is cut
+ * into gso_size datagrams by the device or by dev_hard_start_xmit().
+ */
+static int udp4_gso_setup(struct sock *sk, struct sk_buff *skb)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	unsigned int mss = inet->cork.gso_size;
+	unsigned int datalen = udp_sk(sk)->len - sizeof(struct udphdr);
+
+	if (datalen > mss * UDP_MAX_SEGMENTS)
+		return -EINVAL;
+	if (IS_UDPLITE(sk) || sk->sk_no_check == UDP_CSUM_NOXMIT)
+		return -EINVAL;
+
+	/* Each segment gets its own checksum, which needs a pseudo-header
+	 * sum to start from.
+	 */
+	if (skb->ip_summed != CHECKSUM_PARTIAL || inet->cork.dst->xfrm ||
+	    skb_queue_len(&sk->sk_write_queue) != 1)
+		return -EIO;
+
+	skb_shinfo(skb)->gso_size = mss;
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(datalen, mss);
+	return 0;
+}
+
 /*
  * Push out all pending data as one UDP datagram. Socket is locked.
  */
@@ -729,6 +794,28 @@ static int udp_push_pending_frames(struct sock *sk)
 	uh->len = htons(up->len);
 	uh->check = 0;
 
+	if (inet->cork.gso_size) {
+		/* A segment size the path cannot carry is refused even when
+		 * this send happens to fit in a single segment.
+		 */
+		if (skb_network_header_len(skb) + sizeof(struct udphdr) +
+		    inet->cork.gso_size > inet->cork.fragsize) {
+			ip_flush_pending_frames(sk);
+			err = -EINVAL;
+			goto out;
+		}
+		if (up->len > sizeof(struct udphdr) + inet->cork.gso_size) {
+			err = udp4_gso_setup(sk, skb);
+			if (err) {
+				ip_flush_pending_frames(sk);
+				goto out;
+			}
+			udp4_hwcsum_outgoing(sk, skb, fl->fl4_src, fl->fl4_dst,
+					     up->len);
+			goto send;
+		}
+	}
+
 	if (is_udplite)  				 /*     UDP-Lite      */
 		csum  = udplite_csum_outgoing(sk, skb);
 
@@ -768,6 +855,32 @@ out:
 	return err;
 }
 
+/*
+ * Parse the SOL_UDP control messages of a sendmsg() call.
+ */
+int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (!CMSG_OK(msg, cmsg))
+			return -EINVAL;
+		if (cmsg->cmsg_level != SOL_UDP)
+			continue;
+		switch (cmsg->cmsg_type) {
+		case UDP_SEGMENT:
+			if (cmsg->cmsg_len != CMSG_LEN(sizeof(__u16)))
+				return -EINVAL;
+			*gso_size = *(__u16 *)CMSG_DATA(cmsg);
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(udp_cmsg_send);
+
 int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t len)
 {
@@ -797,6 +910,7 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	ipc.opt = NULL;
 	ipc.shtx.flags = 0;
+	ipc.gso_size = up->gso_size;
 
 	if (up->pending) {
 		/*
@@ -848,6 +962,9 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	if (err)
 		return err;
 	if (msg->msg_controllen) {
+		err = udp_cmsg_send(sk, msg, &ipc.gso_size);
+		if (err)
+			return err;
 		err = ip_cmsg_send(sock_net(sk), msg, &ipc);
 		if (err)
 			return err;
@@ -1185,6 +1302,11 @@ try_again:
 	}
 	if (inet->cmsg_flags)
 		ip_cmsg_recv(msg, skb);
+	if (udp_sk(sk)->gro_enabled && skb_is_gso(skb)) {
+		int gso_size = skb_shinfo(skb)->gso_size;
+
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
 
 	err = len;
 	if (flags & MSG_TRUNC)
@@ -1258,7 +1380,15 @@ EXPORT_SYMBOL(udp_lib_unhash);
 
 static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 {
-	int rc = sock_queue_rcv_skb(sk, skb);
+	int rc;
+
+	if (inet_sk(sk)->inet_daddr) {
+		sock_rps_save_rxhash(sk, skb->rxhash);
+		sk_mark_napi_id(sk, skb);
+	} else
+		sk_mark_napi_id_once(sk, skb);
+
+	rc = sock_queue_rcv_skb(sk, skb);
 
 	if (rc < 0) {
 		int is_udplite = IS_UDPLITE(sk);
@@ -1276,15 +1406,7 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 }
 
-/* returns:
- *  -1: error
- *   0: success
- *  >0: "udp encap" protocol resubmission
- *
- * Note that in the success and error cases, the skb is assumed to
- * have either been requeued or freed.
- */
-int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+static int udp_queue_rcv_one_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct udp_sock *up = udp_sk(sk);
 	int rc;
@@ -1388,6 +1510,67 @@ drop:
 }
 
 
+/*
+ * GRO only coalesces datagrams for sockets that asked for it, but the
+ * flow may have been redirected to another socket since, or UDP_GRO
+ * turned off.  Hand such a socket the datagrams one by one, as they
+ * were on the wire.
+ */
+static int udp_queue_rcv_gso_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *segs, *next;
+	int is_udplite = IS_UDPLITE(sk);
+
+	/* skb_gso_segment() takes the headers from skb->data on. */
+	__skb_push(skb, skb->data - skb_network_header(skb));
+	segs = skb_gso_segment(skb, NETIF_F_SG);
+	if (IS_ERR_OR_NULL(segs)) {
+		UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS, is_udplite);
+		atomic_inc(&sk->sk_drops);
+		kfree_skb(skb);
+		return -1;
+	}
+	consume_skb(skb);
+
+	for (skb = segs; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		/* The checksum of the train was verified before GRO */
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		__skb_pull(skb, skb_transport_offset(skb));
+
+		/* There is no resubmitting an encapsulated segment from
+		 * here, as there is for a single datagram.
+		 */
+		if (udp_queue_rcv_one_skb(sk, skb) > 0) {
+			UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS,
+					 is_udplite);
+			atomic_inc(&sk->sk_drops);
+			kfree_skb(skb);
+		}
+	}
+	return 0;
+}
+
+/* returns:
+ *  -1: error
+ *   0: success
+ *  >0: "udp encap" protocol resubmission
+ *
+ * Note that in the success and error cases, the skb is assumed to
+ * have either been requeued or freed.
+ */
+int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct udp_sock *up = udp_sk(sk);
+
+	if (unlikely((skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) &&
+		     (!up->gro_enabled || up->encap_type)))
+		return udp_queue_rcv_gso_skb(sk, skb);
+
+	return udp_queue_rcv_one_skb(sk, skb);
+}
+
 static void flush_stack(struct sock **stack, unsigned int count,
 			struct sk_buff *skb, unsigned int final)
 {
@@ -1696,6 +1879,24 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		up->pcflag |= UDPLITE_RECV_CC;
 		break;
 
+	case UDP_SEGMENT:
+		/* udpv6_sendmsg() does not segment yet */
+		if (sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val < 0 || val > USHORT_MAX)
+			return -EINVAL;
+		up->gso_size = val;
+		break;
+
+	case UDP_GRO:
+		/* Only udp4_gro_receive() coalesces datagrams. */
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val)
+			udp_gro_needed = 1;
+		up->gro_enabled = val ? 1 : 0;
+		break;
+
 	default:
 		err = -ENOPROTOOPT;
 		break;
@@ -1758,6 +1959,14 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->pcrlen;
 		break;
 
+	case UDP_SEGMENT:
+		val = up->gso_size;
+		break;
+
+	case UDP_GRO:
+		val = up->gro_enabled;
+		break;
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -2109,6 +2318,7 @@ void __init udp_init(void)
 	unsigned long nr_pages, limit;
 
 	udp_table_init(&udp_table, "UDP");
+	percpu_counter_init(&udp_memory_allocated, 0);
 	/* Set the pressure threshold up by the same strategy of TCP. It is a
 	 * fraction of global memory that is up to 1/2 at 256 MB, decreasing
 	 * toward zero with the amount of memory, with a floor of 128 pages.
@@ -2144,6 +2354,71 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/*
+ * Segment a UDP_SEGMENT skb into gso_size datagrams.  Unlike UFO every
+ * segment is a complete datagram with its own UDP header and checksum.
+ */
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct udphdr *uh;
+	unsigned int mss;
+	unsigned int oldlen;
+	unsigned int len;
+	__be32 delta;
+
+	if (!pskb_may_pull(skb, sizeof(*uh)))
+		goto out;
+
+	mss = skb_shinfo(skb)->gso_size;
+	if (unlikely(skb->len <= sizeof(*uh) + mss))
+		goto out;
+
+	if (skb_gso_ok(skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		int type = skb_shinfo(skb)->gso_type;
+
+		if (unlikely(type & ~(SKB_GSO_UDP_L4 | SKB_GSO_DODGY)))
+			goto out;
+
+		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len - sizeof(*uh),
+							 mss);
+
+		segs = NULL;
+		goto out;
+	}
+
+	oldlen = (u16)~skb->len;
+	__skb_pull(skb, sizeof(*uh));
+
+	segs = skb_segment(skb, features);
+	if (IS_ERR(segs))
+		goto out;
+
+	/* The header of every segment is a copy of the original one, whose
+	 * checksum field holds the pseudo-header sum over the full length.
+	 */
+	skb = segs;
+	do {
+		uh = udp_hdr(skb);
+		len = skb->len - skb_transport_offset(skb);
+		delta = htonl(oldlen + len);
+
+		uh->len = htons(len);
+		uh->check = ~csum_fold((__force __wsum)((__force u32)uh->check +
+							(__force u32)delta));
+		if (skb->ip_summed != CHECKSUM_PARTIAL) {
+			uh->check = csum_fold(csum_partial(uh, sizeof(*uh),
+							   skb->csum));
+			if (uh->check == 0)
+				uh->check = CSUM_MANGLED_0;
+		}
+	} while ((skb = skb->next));
+
+out:
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, int features)
 {
 	struct sk_buff *segs = ERR_PTR(-EINVAL);
@@ -2151,6 +2426,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, int features)
 	int offset;
 	__wsum csum;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -2186,3 +2464,130 @@ out:
 	return segs;
 }
 
+/*
+ * UDP GRO: datagrams of one flow towards a socket that enabled UDP_GRO
+ * are chained into one skb, which recvmsg() hands out in one go along
+ * with the segment size.  All datagrams but the last one of a train
+ * must have the size of the first.
+ */
+struct sk_buff **udp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	struct udphdr *uh;
+	struct iphdr *iph;
+	struct sock *sk;
+	unsigned int len;
+	unsigned int mss = 1;
+	unsigned int hlen;
+	unsigned int off;
+	int gro_enabled;
+	int flush = 1;
+
+	if (!udp_gro_needed)
+		goto out;
+
+	off = skb_gro_offset(skb);
+	hlen = off + sizeof(*uh);
+	uh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		uh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!uh))
+			goto out;
+	}
+
+	if (ntohs(uh->len) != skb_gro_len(skb))
+		goto out;
+
+	iph = skb_gro_network_header(skb);
+	if (ipv4_is_multicast(iph->daddr) || ipv4_is_lbcast(iph->daddr))
+		goto out;
+
+	sk = __udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, skb->dev->ifindex,
+			       &udp_table);
+	if (!sk)
+		goto out;
+	gro_enabled = udp_sk(sk)->gro_enabled && !udp_sk(sk)->encap_type;
+	sock_put(sk);
+	if (!gro_enabled)
+		goto out;
+
+	if (uh->check) {
+		switch (skb->ip_summed) {
+		case CHECKSUM_COMPLETE:
+			if (!csum_tcpudp_magic(iph->saddr, iph->daddr,
+					       skb_gro_len(skb), IPPROTO_UDP,
+					       skb->csum)) {
+				skb->ip_summed = CHECKSUM_UNNECESSARY;
+				break;
+			}
+
+			/* fall through */
+		case CHECKSUM_NONE:
+			goto out;
+		}
+	}
+
+	skb_gro_pull(skb, sizeof(*uh));
+	len = skb_gro_len(skb);
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		if (*(u32 *)&uh->source ^ *(u32 *)&udp_hdr(p)->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		goto found;
+	}
+
+	goto out_check_final;
+
+found:
+	flush = NAPI_GRO_CB(p)->flush;
+	mss = skb_shinfo(p)->gso_size;
+
+	flush |= len > mss;
+	flush |= NAPI_GRO_CB(p)->count >= UDP_MAX_SEGMENTS;
+
+	if (flush || skb_gro_receive(head, skb)) {
+		mss = 1;
+		goto out_check_final;
+	}
+
+	p = *head;
+
+out_check_final:
+	/* A short datagram ends the train. */
+	flush = len < mss;
+
+	if (p && (!NAPI_GRO_CB(skb)->same_flow || flush))
+		pp = head;
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+int udp4_gro_complete(struct sk_buff *skb)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+	struct udphdr *uh = udp_hdr(skb);
+	unsigned int len = skb->len - skb_transport_offset(skb);
+
+	uh->len = htons(len);
+	uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr, len,
+				       IPPROTO_UDP, 0);
+	skb->csum_start = skb_transport_header(skb) - skb->head;
+	skb->csum_offset = offsetof(struct udphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+
+	return 0;
+}
@@ -32,6 +32,9 @@ int inet6_csk_bind_conflict(const struct sock *sk,
 {
 	const struct sock *sk2;
 	const struct hlist_node *node;
+	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	int uid = sock_i_uid((struct sock *)sk);
 
 	/* We must walk the whole port owner list in this case. -DaveM */
 	/*
@@ -43,8 +46,11 @@ int inet6_csk_bind_conflict(const struct sock *sk,
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if) &&
-		    (!sk->sk_reuse || !sk2->sk_reuse ||
+		    (!reuse || !sk2->sk_reuse ||
 		     sk2->sk_state == TCP_LISTEN) &&
+		    (!reuseport || !sk2->sk_reuseport ||
+		     (sk2->sk_state != TCP_TIME_WAIT &&
+		      uid != sock_i_uid((struct sock *)sk2))) &&
 		     ipv6_rcv_saddr_equal(sk, sk2))
 			break;
 	}
@@ -76,22 +82,26 @@ static u32 inet6_synq_hash(const struct in6_addr *raddr, const __be16 rport,
 	return c & (synq_hsize - 1);
 }
 
-struct request_sock *inet6_csk_search_req(const struct sock *sk,
-					  struct request_sock ***prevp,
+/* Returns the request with a reference held, see inet_csk_search_req() */
+struct request_sock *inet6_csk_search_req(struct sock *sk,
 					  const __be16 rport,
 					  const struct in6_addr *raddr,
 					  const struct in6_addr *laddr,
 					  const int iif)
 {
-	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	struct request_sock *req, **prev;
-
-	for (prev = &lopt->syn_table[inet6_synq_hash(raddr, rport,
-						     lopt->hash_rnd,
-						     lopt->nr_table_entries)];
-	     (req = *prev) != NULL;
-	     prev = &req->dl_next) {
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct request_sock *req = NULL;
+	struct listen_sock *lopt;
+
+	read_lock(&queue->syn_wait_lock);
+	lopt = queue->listen_opt;
+	if (lopt == NULL)
+		goto out;
+
+	for (req = lopt->syn_table[inet6_synq_hash(raddr, rport,
+						   lopt->hash_rnd,
+						   lopt->nr_table_entries)];
+	     req != NULL; req = req->dl_next) {
 		const struct inet6_request_sock *treq = inet6_rsk(req);
 
 		if (inet_rsk(req)->rmt_port == rport &&
@@ -100,12 +110,13 @@ struct request_sock *inet6_csk_search_req(const struct sock *sk,
 		    ipv6_addr_equal(&treq->loc_addr, laddr) &&
 		    (!treq->iif || treq->iif == iif)) {
 			WARN_ON(req->sk != NULL);
-			*prevp = prev;
-			return req;
+			atomic_inc(&req->rsk_refcnt);
+			break;
 		}
 	}
-
-	return NULL;
+out:
+	read_unlock(&queue->syn_wait_lock);
+	return req;
 }
 
 EXPORT_SYMBOL_GPL(inet6_csk_search_req);
@@ -114,14 +125,24 @@ void inet6_csk_reqsk_queue_hash_add(struct sock *sk,
 				    struct request_sock *req,
 				    const unsigned long timeout)
 {
-	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	const u32 h = inet6_synq_hash(&inet6_rsk(req)->rmt_addr,
-				      inet_rsk(req)->rmt_port,
-				      lopt->hash_rnd, lopt->nr_table_entries);
-
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
-	inet_csk_reqsk_queue_added(sk, timeout);
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct listen_sock *lopt;
+	int prev_qlen = -1;
+
+	write_lock(&queue->syn_wait_lock);
+	lopt = queue->listen_opt;
+	if (lopt != NULL) {
+		const u32 h = inet6_synq_hash(&inet6_rsk(req)->rmt_addr,
+					      inet_rsk(req)->rmt_port,
+					      lopt->hash_rnd,
+					      lopt->nr_table_entries);
+
+		reqsk_queue_hash_req(queue, h, req, timeout);
+		prev_qlen = reqsk_queue_added(queue);
+	}
+	write_unlock(&queue->syn_wait_lock);
+
+	inet_csk_reqsk_queue_added(sk, req, prev_qlen, timeout);
 }
 
 EXPORT_SYMBOL_GPL(inet6_csk_reqsk_queue_hash_add);
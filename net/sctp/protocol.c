@@ -105,6 +105,10 @@ static __init int sctp_proc_init(void)
 {
 	if (percpu_counter_init(&sctp_sockets_allocated, 0))
 		goto out_nomem;
+	if (percpu_counter_init(&sctp_memory_allocated, 0)) {
+		percpu_counter_destroy(&sctp_sockets_allocated);
+		goto out_nomem;
+	}
 #ifdef CONFIG_PROC_FS
 	if (!proc_net_sctp) {
 		proc_net_sctp = proc_mkdir("sctp", init_net.proc_net);
@@ -135,6 +139,7 @@ out_snmp_proc_init:
 		remove_proc_entry("sctp", init_net.proc_net);
 	}
 out_free_percpu:
+	percpu_counter_destroy(&sctp_memory_allocated);
 	percpu_counter_destroy(&sctp_sockets_allocated);
 #else
 	return 0;
@@ -161,6 +166,7 @@ static void sctp_proc_exit(void)
 		remove_proc_entry("sctp", init_net.proc_net);
 	}
 #endif
+	percpu_counter_destroy(&sctp_memory_allocated);
 	percpu_counter_destroy(&sctp_sockets_allocated);
 }
 